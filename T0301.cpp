@@ -1,7 +1,19 @@
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <utility>
 #include <vector>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 struct Rectangle {
   int x_left = 0;
   int y_left = 0;
@@ -12,15 +24,19 @@ struct Rectangle {
     return ((x_left <= x_right) && (y_left <= y_right));
   }
 
-  [[nodiscard]] int area() const {
+  // Exact: each side is below 2^32, so the product fits in 64 unsigned bits.
+  [[nodiscard]] std::uint64_t area() const {
     if (is_valid()) {
-      return (y_right - y_left) * (x_right - x_left);
+      return static_cast<std::uint64_t>(std::int64_t{y_right} - y_left) *
+             static_cast<std::uint64_t>(std::int64_t{x_right} - x_left);
     }
     return 0;
   }
 };
 
-int rectangle_intersection_area(const std::vector<Rectangle>& rectangles) {
+// Stops at the first empty partial intersection: it can only shrink.
+std::uint64_t rectangle_intersection_area(
+    const std::vector<Rectangle>& rectangles) {
   int count = static_cast<int>(rectangles.size());
   if (count == 0) {
     return 0;
@@ -31,6 +47,9 @@ int rectangle_intersection_area(const std::vector<Rectangle>& rectangles) {
     Answer.x_right = std::min(rectangles[i].x_right, Answer.x_right);
     Answer.y_left = std::max(rectangles[i].y_left, Answer.y_left);
     Answer.y_right = std::min(rectangles[i].y_right, Answer.y_right);
+    if (!Answer.is_valid()) {
+      return 0;
+    }
   }
   return Answer.area();
 }
@@ -50,7 +69,1070 @@ Rectangle rectangle_union(const std::vector<Rectangle>& rectangles) {
   return Answer;
 }
 
-int main() {
+// Smallest or, with kLargest, largest of values[0, count) and `init`.
+// Four accumulators, so that consecutive loads do not wait on each other.
+template <bool kLargest>
+int extreme(const int* values, std::size_t count, int init) {
+  auto pick = [](int a, int b) {
+    return kLargest ? std::max(a, b) : std::min(a, b);
+  };
+  std::size_t i = 0;
+#if defined(__AVX2__)
+  auto pick_lanes = [](__m256i a, __m256i b) {
+    return kLargest ? _mm256_max_epi32(a, b) : _mm256_min_epi32(a, b);
+  };
+  __m256i acc[4];
+  for (__m256i& lanes : acc) lanes = _mm256_set1_epi32(init);
+  for (; i + 32 <= count; i += 32) {
+    const auto* block = reinterpret_cast<const __m256i*>(values + i);
+    for (int k = 0; k < 4; ++k) {
+      acc[k] = pick_lanes(acc[k], _mm256_loadu_si256(block + k));
+    }
+  }
+  alignas(32) int lanes[8];
+  _mm256_store_si256(
+      reinterpret_cast<__m256i*>(lanes),
+      pick_lanes(pick_lanes(acc[0], acc[1]), pick_lanes(acc[2], acc[3])));
+  for (int lane : lanes) init = pick(init, lane);
+#else
+  int first = init, second = init, third = init, fourth = init;
+  for (; i + 4 <= count; i += 4) {
+    first = pick(first, values[i]);
+    second = pick(second, values[i + 1]);
+    third = pick(third, values[i + 2]);
+    fourth = pick(fourth, values[i + 3]);
+  }
+  init = pick(pick(first, second), pick(third, fourth));
+#endif
+  for (; i < count; ++i) init = pick(init, values[i]);
+  return init;
+}
+
+// Rectangles as four coordinate arrays, so that each reduction streams one
+// of them with whole-register min and max.
+class RectangleBatch {
+ public:
+  RectangleBatch() = default;
+
+  explicit RectangleBatch(const std::vector<Rectangle>& rectangles) {
+    reserve(rectangles.size());
+    for (const Rectangle& rectangle : rectangles) {
+      push_back(rectangle);
+    }
+  }
+
+  void reserve(std::size_t count) {
+    x_left.reserve(count);
+    y_left.reserve(count);
+    x_right.reserve(count);
+    y_right.reserve(count);
+  }
+
+  void push_back(const Rectangle& rectangle) {
+    x_left.push_back(rectangle.x_left);
+    y_left.push_back(rectangle.y_left);
+    x_right.push_back(rectangle.x_right);
+    y_right.push_back(rectangle.y_right);
+  }
+
+  [[nodiscard]] std::size_t size() const { return x_left.size(); }
+
+  // The same as rectangle_intersection_area. Each thread reduces one
+  // contiguous part a block at a time and all of them stop as soon as any
+  // part has an empty intersection, since the whole one is then empty too.
+  [[nodiscard]] std::uint64_t intersection_area(unsigned threads = 1) const {
+    if (size() == 0) {
+      return 0;
+    }
+    std::atomic<bool> empty{false};
+    Rectangle intersection = reduce(
+        threads, [&](Rectangle& answer, std::size_t begin, std::size_t end) {
+          for (std::size_t block = begin; block < end; block += kBlock) {
+            if (empty.load(std::memory_order_relaxed)) {
+              return;
+            }
+            std::size_t count = std::min(kBlock, end - block);
+            answer.x_left =
+                extreme<true>(x_left.data() + block, count, answer.x_left);
+            answer.y_left =
+                extreme<true>(y_left.data() + block, count, answer.y_left);
+            answer.x_right =
+                extreme<false>(x_right.data() + block, count, answer.x_right);
+            answer.y_right =
+                extreme<false>(y_right.data() + block, count, answer.y_right);
+            if (!answer.is_valid()) {
+              empty.store(true, std::memory_order_relaxed);
+              return;
+            }
+          }
+        },
+        [](Rectangle& answer, const Rectangle& part) {
+          answer.x_left = std::max(answer.x_left, part.x_left);
+          answer.y_left = std::max(answer.y_left, part.y_left);
+          answer.x_right = std::min(answer.x_right, part.x_right);
+          answer.y_right = std::min(answer.y_right, part.y_right);
+        });
+    return empty ? 0 : intersection.area();
+  }
+
+  // The same as rectangle_union.
+  [[nodiscard]] Rectangle bounding_box(unsigned threads = 1) const {
+    if (size() == 0) {
+      return {};
+    }
+    return reduce(
+        threads,
+        [&](Rectangle& answer, std::size_t begin, std::size_t end) {
+          std::size_t count = end - begin;
+          answer.x_left =
+              extreme<false>(x_left.data() + begin, count, answer.x_left);
+          answer.y_left =
+              extreme<false>(y_left.data() + begin, count, answer.y_left);
+          answer.x_right =
+              extreme<true>(x_right.data() + begin, count, answer.x_right);
+          answer.y_right =
+              extreme<true>(y_right.data() + begin, count, answer.y_right);
+        },
+        [](Rectangle& answer, const Rectangle& part) {
+          answer.x_left = std::min(answer.x_left, part.x_left);
+          answer.y_left = std::min(answer.y_left, part.y_left);
+          answer.x_right = std::max(answer.x_right, part.x_right);
+          answer.y_right = std::max(answer.y_right, part.y_right);
+        });
+  }
+
+ private:
+  // Large enough to amortise the check, small enough to stop soon.
+  static constexpr std::size_t kBlock = 1024;
+  // Below this, starting threads costs more than it saves.
+  static constexpr std::size_t kMinPerThread = 1 << 16;
+
+  [[nodiscard]] Rectangle at(std::size_t i) const {
+    return {x_left[i], y_left[i], x_right[i], y_right[i]};
+  }
+
+  // Splits [0, size()) into up to `threads` parts, each reduced by
+  // reduce_part(answer, begin, end) from its first rectangle, then merges
+  // the parts in order.
+  template <typename ReducePart, typename Merge>
+  Rectangle reduce(unsigned threads, ReducePart&& reduce_part,
+                   Merge&& merge) const {
+    threads = static_cast<unsigned>(std::clamp<std::size_t>(
+        size() / kMinPerThread, 1, std::max(1u, threads)));
+    std::vector<Rectangle> partial(threads);
+    auto work = [&](unsigned part) {
+      std::size_t begin = size() * part / threads;
+      std::size_t end = size() * (part + 1) / threads;
+      partial[part] = at(begin);
+      reduce_part(partial[part], begin + 1, end);
+    };
+    std::vector<std::thread> workers;
+    for (unsigned part = 1; part < threads; ++part) {
+      workers.emplace_back(work, part);
+    }
+    work(0);
+    for (std::thread& worker : workers) worker.join();
+    Rectangle answer = partial[0];
+    for (unsigned part = 1; part < threads; ++part) {
+      merge(answer, partial[part]);
+    }
+    return answer;
+  }
+
+  std::vector<int> x_left, y_left, x_right, y_right;
+};
+
+// Area covered by at least one of the rectangles (Klee's measure problem),
+// by a sweep over x with a segment tree over the compressed y coordinates:
+// O(n log n). Invalid rectangles cover nothing. The area is exact: the
+// union lies within a 2^32 by 2^32 square, so it fits in 64 unsigned bits.
+std::uint64_t rectangle_union_area(const std::vector<Rectangle>& rectangles) {
+  struct Event {
+    int x;
+    int delta;
+    int y_low;
+    int y_high;
+  };
+  std::vector<Event> events;
+  std::vector<int> ys;
+  events.reserve(2 * rectangles.size());
+  ys.reserve(2 * rectangles.size());
+  for (const Rectangle& rectangle : rectangles) {
+    if (rectangle.x_left >= rectangle.x_right ||
+        rectangle.y_left >= rectangle.y_right) {
+      continue;
+    }
+    events.push_back(
+        {rectangle.x_left, 1, rectangle.y_left, rectangle.y_right});
+    events.push_back(
+        {rectangle.x_right, -1, rectangle.y_left, rectangle.y_right});
+    ys.push_back(rectangle.y_left);
+    ys.push_back(rectangle.y_right);
+  }
+  if (events.empty()) {
+    return 0;
+  }
+  std::sort(events.begin(), events.end(),
+            [](const Event& left, const Event& right) {
+              return left.x < right.x;
+            });
+  std::sort(ys.begin(), ys.end());
+  ys.erase(std::unique(ys.begin(), ys.end()), ys.end());
+
+  // A bottom-up segment tree over the elementary intervals
+  // [ys[i], ys[i + 1]): node v has `count` rectangles covering all of its
+  // `length` that were not pushed further down, and `covered` of its length
+  // is covered by some active rectangle. Padding leaves have no length.
+  struct Node {
+    int count;
+    std::uint64_t length;
+    std::uint64_t covered;
+  };
+  std::size_t leaves = 1;
+  while (leaves < ys.size() - 1) {
+    leaves *= 2;
+  }
+  std::vector<Node> tree(2 * leaves, Node{0, 0, 0});
+  for (std::size_t i = 0; i + 1 < ys.size(); ++i) {
+    tree[leaves + i].length = static_cast<std::uint64_t>(
+        static_cast<std::int64_t>(ys[i + 1]) - ys[i]);
+  }
+  for (std::size_t v = leaves - 1; v > 0; --v) {
+    tree[v].length = tree[2 * v].length + tree[2 * v + 1].length;
+  }
+  auto pull = [&](std::size_t v) {
+    Node& node = tree[v];
+    if (node.count > 0) {
+      node.covered = node.length;
+    } else if (v >= leaves) {
+      node.covered = 0;
+    } else {
+      node.covered = tree[2 * v].covered + tree[2 * v + 1].covered;
+    }
+  };
+  auto update = [&](std::size_t from, std::size_t to, int delta) {
+    for (std::size_t low = from + leaves, high = to + leaves; low < high;
+         low /= 2, high /= 2) {
+      if (low & 1) {
+        tree[low].count += delta;
+        pull(low++);
+      }
+      if (high & 1) {
+        tree[--high].count += delta;
+        pull(high);
+      }
+    }
+    // Refresh the ancestors of both ends, once each where the paths meet.
+    std::size_t low = (from + leaves) / 2, high = (to - 1 + leaves) / 2;
+    for (; low != high; low /= 2, high /= 2) {
+      pull(low);
+      pull(high);
+    }
+    for (; low > 0; low /= 2) {
+      pull(low);
+    }
+  };
+
+  std::uint64_t area = 0;
+  for (std::size_t i = 0; i < events.size(); ++i) {
+    const Event& event = events[i];
+    if (i > 0) {
+      auto width = static_cast<std::uint64_t>(
+          static_cast<std::int64_t>(event.x) - events[i - 1].x);
+      area += width * tree[1].covered;
+    }
+    std::size_t from =
+        std::lower_bound(ys.begin(), ys.end(), event.y_low) - ys.begin();
+    std::size_t to =
+        std::lower_bound(ys.begin(), ys.end(), event.y_high) - ys.begin();
+    update(from, to, event.delta);
+  }
+  return area;
+}
+
+// Rectangles are closed: two of them intersect when they share at least a
+// point, so touching edges and corners count. That is exactly when their
+// intersection is_valid(), as in rectangle_intersection_area, and never when
+// either of them is invalid.
+[[nodiscard]] bool intersects(const Rectangle& a, const Rectangle& b) {
+  return std::max(a.x_left, b.x_left) <= std::min(a.x_right, b.x_right) &&
+         std::max(a.y_left, b.y_left) <= std::min(a.y_right, b.y_right);
+}
+
+// Whether the valid rectangle `inner` lies within `outer`, edges included.
+[[nodiscard]] bool contains(const Rectangle& outer, const Rectangle& inner) {
+  return inner.is_valid() && outer.x_left <= inner.x_left &&
+         inner.x_right <= outer.x_right && outer.y_left <= inner.y_left &&
+         inner.y_right <= outer.y_right;
+}
+
+// A packed Hilbert R-tree in flat arrays: the rectangles in the order of
+// their centres along a Hilbert curve, then the bounding boxes of each run
+// of kFanout of them, of each run of kFanout of those, and so on up to the
+// root. The children of node j are j * kFanout onwards on the level below.
+//
+// Packed trees cannot grow, so the index keeps several, by the logarithmic
+// method: tree k holds at most kBuffer << k rectangles. Inserted rectangles
+// wait in a buffer of at most kBuffer that every query scans; a full buffer
+// is packed into tree 0, merging with it and the trees above it like a
+// carry in a binary counter. A rectangle moves up O(log n) times, and a
+// query searches O(log n) trees. Erased rectangles leave a tombstone that
+// matches nothing, and a tree that is half tombstones is repacked. A
+// rectangle keeps the id it was given, its position in the constructor's
+// vector or the value returned by insert(), until it is erased.
+class RectangleIndex {
+ public:
+  using Id = std::uint32_t;
+
+  // Results of a batch of queries: the ids matching query i are
+  // ids[offsets[i]] up to ids[offsets[i + 1]], in no particular order.
+  struct Matches {
+    std::vector<std::size_t> offsets;
+    std::vector<Id> ids;
+  };
+
+  static constexpr std::size_t kFanout = 16;
+  static constexpr std::size_t kBuffer = 64;
+
+  RectangleIndex() = default;
+
+  explicit RectangleIndex(std::vector<Rectangle> rectangles)
+      : by_id(std::move(rectangles)), slots(by_id.size()), live(by_id.size()) {
+    std::vector<Id> order(live);
+    for (std::size_t id = 0; id < live; ++id) {
+      order[id] = static_cast<Id>(id);
+    }
+    std::size_t tree = 0;
+    while (capacity(tree) < order.size()) ++tree;
+    pack(tree, std::move(order));
+  }
+
+  [[nodiscard]] std::size_t size() const { return live; }
+
+  [[nodiscard]] const Rectangle& rectangle(Id id) const {
+    return by_id[id];
+  }
+
+  Id insert(const Rectangle& rectangle) {
+    auto id = static_cast<Id>(by_id.size());
+    by_id.push_back(rectangle);
+    slots.push_back({kPending, static_cast<std::uint32_t>(pending.size())});
+    pending.push_back(id);
+    ++live;
+    if (pending.size() == kBuffer) {
+      flush();
+    }
+    return id;
+  }
+
+  // Returns false when there is no rectangle with this id.
+  bool erase(Id id) {
+    if (id >= slots.size() || slots[id].tree == kErased) {
+      return false;
+    }
+    Slot slot = slots[id];
+    slots[id].tree = kErased;
+    --live;
+    if (slot.tree == kPending) {
+      pending[slot.position] = pending.back();
+      pending.pop_back();
+      if (slot.position < pending.size()) {
+        slots[pending[slot.position]].position = slot.position;
+      }
+      return true;
+    }
+    Packed& tree = trees[slot.tree];
+    tree.entries[slot.position] = kTombstone;
+    if (++tree.tombstones * 2 > tree.entries.size()) {
+      pack(slot.tree, live_ids(tree));
+    }
+    return true;
+  }
+
+  // Calls visit(id) for every rectangle that intersects `query`.
+  template <typename Visitor>
+  void for_each_intersecting(const Rectangle& query, Visitor&& visit) const {
+    search([&](const Rectangle& box) { return intersects(box, query); }, visit);
+  }
+
+  // Calls visit(id) for every rectangle that contains `query`.
+  template <typename Visitor>
+  void for_each_containing(const Rectangle& query, Visitor&& visit) const {
+    search([&](const Rectangle& box) { return contains(box, query); }, visit);
+  }
+
+  [[nodiscard]] std::vector<Id> intersecting(const Rectangle& query) const {
+    std::vector<Id> ids;
+    for_each_intersecting(query, [&](Id id) { ids.push_back(id); });
+    return ids;
+  }
+
+  [[nodiscard]] std::vector<Id> containing(const Rectangle& query) const {
+    std::vector<Id> ids;
+    for_each_containing(query, [&](Id id) { ids.push_back(id); });
+    return ids;
+  }
+
+  // The queries run in Hilbert order, so that consecutive ones mostly walk
+  // the same, already cached, nodes.
+  [[nodiscard]] Matches intersecting(
+      const std::vector<Rectangle>& queries) const {
+    return batch(queries, [this](const Rectangle& query, auto&& visit) {
+      for_each_intersecting(query, visit);
+    });
+  }
+
+  [[nodiscard]] Matches containing(
+      const std::vector<Rectangle>& queries) const {
+    return batch(queries, [this](const Rectangle& query, auto&& visit) {
+      for_each_containing(query, visit);
+    });
+  }
+
+  // Calls visit(first, second), with first < second, once for every pair of
+  // intersecting rectangles, by querying the index with each of them in
+  // Hilbert order.
+  template <typename Visitor>
+  void for_each_overlapping_pair(Visitor&& visit) const {
+    auto query_with = [&](Id first) {
+      for_each_intersecting(by_id[first], [&](Id second) {
+        if (first < second) {
+          visit(first, second);
+        }
+      });
+    };
+    for (const Packed& tree : trees) {
+      for (Id id : tree.ids) {
+        if (slots[id].tree != kErased) {
+          query_with(id);
+        }
+      }
+    }
+    for (Id id : pending) {
+      query_with(id);
+    }
+  }
+
+  [[nodiscard]] std::vector<std::pair<Id, Id>> overlapping_pairs() const {
+    std::vector<std::pair<Id, Id>> pairs;
+    for_each_overlapping_pair(
+        [&](Id first, Id second) { pairs.emplace_back(first, second); });
+    return pairs;
+  }
+
+  [[nodiscard]] std::size_t memory_bytes() const {
+    std::size_t bytes = by_id.capacity() * sizeof(Rectangle) +
+                        slots.capacity() * sizeof(Slot) +
+                        pending.capacity() * sizeof(Id);
+    for (const Packed& tree : trees) {
+      bytes += (tree.entries.capacity() + tree.nodes.capacity()) *
+                   sizeof(Rectangle) +
+               tree.ids.capacity() * sizeof(Id) +
+               tree.level_begin.capacity() * sizeof(std::size_t);
+    }
+    return bytes;
+  }
+
+ private:
+  // Where a rectangle is: a position in trees[tree] or in pending.
+  struct Slot {
+    std::uint32_t tree;
+    std::uint32_t position;
+  };
+
+  struct Packed {
+    // In Hilbert order; kTombstone once erased.
+    std::vector<Rectangle> entries;
+    std::vector<Id> ids;
+    std::vector<Rectangle> nodes;  // Level by level, from the leaves up.
+    std::vector<std::size_t> level_begin = {0};
+    std::size_t tombstones = 0;
+  };
+
+  static constexpr std::uint32_t kPending = UINT32_MAX - 1;
+  static constexpr std::uint32_t kErased = UINT32_MAX;
+  // Intersects and contains nothing, even as a bounding box.
+  static constexpr Rectangle kTombstone{INT32_MAX, INT32_MAX, INT32_MIN,
+                                        INT32_MIN};
+  // Deep enough for 2^32 rectangles: a level holds at most kFanout - 1
+  // unvisited siblings at a time.
+  static constexpr std::size_t kMaxStack = 8 * (kFanout - 1) + 1;
+
+  static std::size_t capacity(std::size_t tree) { return kBuffer << tree; }
+
+  // Position of (x, y) along a Hilbert curve through the 2^32 by 2^32
+  // grid, which visits each quadrant, at every scale, before the next.
+  static std::uint64_t hilbert_key(std::uint32_t x, std::uint32_t y) {
+    std::uint64_t key = 0;
+    for (std::uint32_t half = std::uint32_t{1} << 31; half > 0; half /= 2) {
+      std::uint32_t right = (x & half) ? 1 : 0;
+      std::uint32_t up = (y & half) ? 1 : 0;
+      key += std::uint64_t{half} * half * ((3 * right) ^ up);
+      if (!up) {
+        if (right) {
+          x = ~x;
+          y = ~y;
+        }
+        std::swap(x, y);
+      }
+    }
+    return key;
+  }
+
+  // Sorts `order`, indexes into `boxes`, by the Hilbert key of each box's
+  // centre. Nearby centres stay together at every scale, so every run of
+  // kFanout boxes, and of kFanout such runs and so on, is compact.
+  static void hilbert_order(std::vector<Id>& order,
+                            const std::vector<Rectangle>& boxes) {
+    // Twice the centre, shifted to be non-negative, halved.
+    auto coordinate = [](int low, int high) {
+      return static_cast<std::uint32_t>(
+          (static_cast<std::int64_t>(low) + high - 2 * std::int64_t{INT32_MIN})
+          >> 1);
+    };
+    std::vector<std::pair<std::uint64_t, Id>> keyed(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      const Rectangle& box = boxes[order[i]];
+      keyed[i] = {hilbert_key(coordinate(box.x_left, box.x_right),
+                              coordinate(box.y_left, box.y_right)),
+                  order[i]};
+    }
+    std::sort(keyed.begin(), keyed.end());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = keyed[i].second;
+    }
+  }
+
+  static Rectangle bounding_box(const Rectangle* boxes, std::size_t count) {
+    Rectangle box = boxes[0];
+    for (std::size_t i = 1; i < count; ++i) {
+      box.x_left = std::min(box.x_left, boxes[i].x_left);
+      box.y_left = std::min(box.y_left, boxes[i].y_left);
+      box.x_right = std::max(box.x_right, boxes[i].x_right);
+      box.y_right = std::max(box.y_right, boxes[i].y_right);
+    }
+    return box;
+  }
+
+  std::vector<Id> live_ids(const Packed& tree) const {
+    std::vector<Id> ids;
+    ids.reserve(tree.ids.size() - tree.tombstones);
+    for (Id id : tree.ids) {
+      if (slots[id].tree != kErased) {
+        ids.push_back(id);
+      }
+    }
+    return ids;
+  }
+
+  // Replaces trees[index] with a tree packed from `order`.
+  void pack(std::size_t index, std::vector<Id> order) {
+    if (trees.size() <= index) {
+      trees.resize(index + 1);
+    }
+    hilbert_order(order, by_id);
+    Packed& tree = trees[index];
+    tree.entries.clear();
+    tree.entries.reserve(order.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      tree.entries.push_back(by_id[order[i]]);
+      slots[order[i]] = {static_cast<std::uint32_t>(index),
+                         static_cast<std::uint32_t>(i)};
+    }
+    tree.ids = std::move(order);
+    tree.tombstones = 0;
+    // Reserved up front, since each level is built from the one below.
+    std::size_t total = 0;
+    for (std::size_t count = tree.entries.size(); count > 1;) {
+      count = (count + kFanout - 1) / kFanout;
+      total += count;
+    }
+    tree.nodes.clear();
+    tree.nodes.reserve(total + 1);
+    tree.level_begin.assign(1, 0);
+    const Rectangle* children = tree.entries.data();
+    std::size_t count = tree.entries.size();
+    while (count > 0) {
+      std::size_t parents = (count + kFanout - 1) / kFanout;
+      for (std::size_t j = 0; j < parents; ++j) {
+        std::size_t first = j * kFanout;
+        tree.nodes.push_back(
+            bounding_box(children + first, std::min(kFanout, count - first)));
+      }
+      tree.level_begin.push_back(tree.nodes.size());
+      children =
+          tree.nodes.data() + tree.level_begin[tree.level_begin.size() - 2];
+      count = parents == 1 ? 0 : parents;
+    }
+  }
+
+  // Carries the buffer up through the trees until it fits in an empty one.
+  void flush() {
+    std::vector<Id> carry = std::move(pending);
+    pending.clear();
+    for (std::size_t index = 0;; ++index) {
+      bool empty = index >= trees.size() || trees[index].ids.empty();
+      if (empty && carry.size() <= capacity(index)) {
+        pack(index, std::move(carry));
+        return;
+      }
+      if (!empty) {
+        std::vector<Id> ids = live_ids(trees[index]);
+        carry.insert(carry.end(), ids.begin(), ids.end());
+        trees[index] = Packed();
+      }
+    }
+  }
+
+  // Calls visit(id) for the rectangles that pass `test`, walking only the
+  // nodes whose bounding box passes it too. Since intersecting or containing
+  // the query takes a box that does, the test serves for both.
+  template <typename Test, typename Visitor>
+  void search(Test&& test, Visitor&& visit) const {
+    for (const Packed& tree : trees) {
+      std::size_t levels = tree.level_begin.size() - 1;
+      if (levels == 0 || !test(tree.nodes.back())) {
+        continue;
+      }
+      // Level 0 holds the parents of the entries.
+      struct Item {
+        std::size_t level;
+        std::size_t node;
+      };
+      Item stack[kMaxStack];
+      std::size_t top = 0;
+      stack[top++] = {levels - 1, 0};
+      while (top > 0) {
+        Item item = stack[--top];
+        std::size_t first = item.node * kFanout;
+        if (item.level == 0) {
+          std::size_t last = std::min(first + kFanout, tree.entries.size());
+          for (std::size_t i = first; i < last; ++i) {
+            if (test(tree.entries[i])) {
+              visit(tree.ids[i]);
+            }
+          }
+          continue;
+        }
+        const Rectangle* level =
+            tree.nodes.data() + tree.level_begin[item.level - 1];
+        std::size_t last = std::min(
+            first + kFanout,
+            tree.level_begin[item.level] - tree.level_begin[item.level - 1]);
+        for (std::size_t i = first; i < last; ++i) {
+          if (test(level[i])) {
+            stack[top++] = {item.level - 1, i};
+          }
+        }
+      }
+    }
+    for (Id id : pending) {
+      if (test(by_id[id])) {
+        visit(id);
+      }
+    }
+  }
+
+  template <typename Query>
+  Matches batch(const std::vector<Rectangle>& queries, Query&& query) const {
+    std::vector<Id> order(queries.size());
+    for (std::size_t i = 0; i < order.size(); ++i) {
+      order[i] = static_cast<Id>(i);
+    }
+    hilbert_order(order, queries);
+    std::vector<std::pair<Id, Id>> found;
+    for (Id i : order) {
+      query(queries[i], [&](Id id) { found.emplace_back(i, id); });
+    }
+    Matches matches;
+    matches.offsets.assign(queries.size() + 1, 0);
+    for (const auto& [i, id] : found) {
+      ++matches.offsets[i + 1];
+    }
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+      matches.offsets[i + 1] += matches.offsets[i];
+    }
+    matches.ids.resize(found.size());
+    std::vector<std::size_t> next(matches.offsets.begin(),
+                                  matches.offsets.end() - 1);
+    for (const auto& [i, id] : found) {
+      matches.ids[next[i]++] = id;
+    }
+    return matches;
+  }
+
+  std::vector<Rectangle> by_id;
+  std::vector<Slot> slots;  // By id; tree is kPending or kErased if not in one.
+  std::vector<Packed> trees;
+  std::vector<Id> pending;
+  std::size_t live = 0;
+};
+
+// The union area by marking every unit cell, for coordinates in
+// [0, size].
+std::uint64_t grid_union_area(const std::vector<Rectangle>& rectangles,
+                              int size) {
+  std::vector<char> cells(static_cast<std::size_t>(size) * size, 0);
+  for (const Rectangle& rectangle : rectangles) {
+    for (int y = rectangle.y_left; y < rectangle.y_right; ++y) {
+      for (int x = rectangle.x_left; x < rectangle.x_right; ++x) {
+        cells[static_cast<std::size_t>(y) * size + x] = 1;
+      }
+    }
+  }
+  return std::count(cells.begin(), cells.end(), 1);
+}
+
+std::vector<Rectangle> random_rectangles(std::size_t count, int size,
+                                         int max_side, std::mt19937& gen) {
+  std::uniform_int_distribution<int> corner(0, size - 1);
+  std::uniform_int_distribution<int> side(0, max_side);
+  std::vector<Rectangle> rectangles;
+  for (std::size_t i = 0; i < count; ++i) {
+    int x = corner(gen), y = corner(gen);
+    rectangles.push_back(
+        {x, y, std::min(size, x + side(gen)), std::min(size, y + side(gen))});
+  }
+  return rectangles;
+}
+
+void test_union_area() {
+  assert(rectangle_union_area({}) == 0);
+  assert(rectangle_union_area({{0, 0, 5, 5}}) == 25);
+  assert(rectangle_union_area({{0, 0, 4, 4}, {2, 2, 6, 6}}) == 28);
+  assert(rectangle_union_area({{0, 0, 2, 2}, {3, 3, 5, 5}}) == 8);
+  assert(rectangle_union_area({{0, 0, 10, 10}, {4, 4, 8, 8}}) == 100);
+  assert(rectangle_union_area({{5, 5, 1, 1}, {0, 0, 0, 9}}) == 0);
+  // The whole int plane, and a union larger than INT64_MAX.
+  const int kMin = INT32_MIN, kMax = INT32_MAX;
+  std::uint64_t side = std::uint64_t{1} << 32;
+  assert(rectangle_union_area({{kMin, kMin, kMax, kMax}}) ==
+         (side - 1) * (side - 1));
+  assert(rectangle_union_area({{kMin, kMin, 0, kMax}, {0, kMin, kMax, kMax},
+                               {-5, -5, 5, 5}}) == (side - 1) * (side - 1));
+
+  std::mt19937 gen(1);
+  for (int round = 0; round < 300; ++round) {
+    int size = 1 + static_cast<int>(gen() % 60);
+    auto rectangles =
+        random_rectangles(gen() % 30, size, 1 + size / 2, gen);
+    assert(rectangle_union_area(rectangles) ==
+           grid_union_area(rectangles, size));
+  }
+}
+
+void test_rectangle_index() {
+  using Id = RectangleIndex::Id;
+  assert(intersects({0, 0, 1, 1}, {1, 1, 2, 2}));
+  assert(intersects({0, 0, 4, 4}, {2, 2, 2, 2}));
+  assert(!intersects({0, 0, 1, 1}, {2, 0, 3, 1}));
+  assert(!intersects({0, 0, 4, 4}, {3, 3, 1, 1}));
+  assert(contains({0, 0, 4, 4}, {0, 0, 4, 4}));
+  assert(contains({0, 0, 4, 4}, {4, 4, 4, 4}));
+  assert(!contains({0, 0, 4, 4}, {3, 3, 5, 4}));
+  assert(!contains({0, 0, 4, 4}, {3, 3, 1, 1}));
+
+  RectangleIndex empty;
+  assert(empty.size() == 0 && empty.intersecting({0, 0, 9, 9}).empty());
+  assert(empty.overlapping_pairs().empty());
+
+  std::mt19937 gen(3);
+  auto sorted = [](std::vector<Id> ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+  };
+  for (int round = 0; round < 20; ++round) {
+    int size = 50 + static_cast<int>(gen() % 200);
+    auto initial = random_rectangles(gen() % 600, size, 20, gen);
+    // Some invalid rectangles, which are stored but never match.
+    initial.push_back({5, 5, 4, 9});
+    initial.push_back({5, 5, 9, 4});
+    RectangleIndex index(initial);
+    std::vector<Rectangle> stored = initial;
+    std::vector<bool> live(stored.size(), true);
+    for (int step = 0; step < 1500; ++step) {
+      if (gen() % 3 != 0) {
+        Rectangle added = random_rectangles(1, size, 20, gen)[0];
+        assert(index.insert(added) == stored.size());
+        stored.push_back(added);
+        live.push_back(true);
+      } else if (!stored.empty()) {
+        Id id = gen() % stored.size();
+        assert(index.erase(id) == live[id]);
+        live[id] = false;
+      }
+    }
+    assert(!index.erase(static_cast<Id>(stored.size())));
+    std::size_t live_count = std::count(live.begin(), live.end(), true);
+    assert(index.size() == live_count);
+
+    auto queries = random_rectangles(100, size, 60, gen);
+    queries.push_back({3, 3, 2, 2});
+    auto intersecting = index.intersecting(queries);
+    auto containing = index.containing(queries);
+    for (std::size_t q = 0; q < queries.size(); ++q) {
+      std::vector<Id> expected_intersecting, expected_containing;
+      for (std::size_t id = 0; id < stored.size(); ++id) {
+        if (live[id] && intersects(stored[id], queries[q])) {
+          expected_intersecting.push_back(static_cast<Id>(id));
+        }
+        if (live[id] && contains(stored[id], queries[q])) {
+          expected_containing.push_back(static_cast<Id>(id));
+        }
+      }
+      assert(sorted(index.intersecting(queries[q])) == expected_intersecting);
+      assert(sorted(index.containing(queries[q])) == expected_containing);
+      assert(sorted({intersecting.ids.begin() + intersecting.offsets[q],
+                     intersecting.ids.begin() + intersecting.offsets[q + 1]}) ==
+             expected_intersecting);
+      assert(sorted({containing.ids.begin() + containing.offsets[q],
+                     containing.ids.begin() + containing.offsets[q + 1]}) ==
+             expected_containing);
+    }
+
+    std::vector<std::pair<Id, Id>> expected_pairs;
+    for (std::size_t i = 0; i < stored.size(); ++i) {
+      for (std::size_t j = i + 1; j < stored.size(); ++j) {
+        if (live[i] && live[j] && intersects(stored[i], stored[j])) {
+          expected_pairs.emplace_back(i, j);
+        }
+      }
+    }
+    auto pairs = index.overlapping_pairs();
+    std::sort(pairs.begin(), pairs.end());
+    assert(pairs == expected_pairs);
+  }
+}
+
+void test_rectangle_batch() {
+  const int kMin = INT32_MIN, kMax = INT32_MAX;
+  std::uint64_t side = (std::uint64_t{1} << 32) - 1;
+  assert((Rectangle{kMin, kMin, kMax, kMax}.area() == side * side));
+  assert((Rectangle{kMin, 0, kMax, 3}.area() == 3 * side));
+  assert(rectangle_intersection_area(
+             {{kMin, kMin, kMax, kMax}, {kMin, -1, kMax, kMax}}) ==
+         side * (std::uint64_t{kMax} + 1));
+  assert(RectangleBatch().intersection_area() == 0);
+  Rectangle empty = RectangleBatch().bounding_box();
+  assert(empty.x_left == 0 && empty.y_left == 0 && empty.x_right == 0 &&
+         empty.y_right == 0);
+
+  std::mt19937 gen(5);
+  auto same = [](const Rectangle& a, const Rectangle& b) {
+    return a.x_left == b.x_left && a.y_left == b.y_left &&
+           a.x_right == b.x_right && a.y_right == b.y_right;
+  };
+  for (std::size_t count : {1, 7, 33, 100, 5000, 300000}) {
+    // Rectangles around a common point, so that the intersection is only
+    // empty when one of the far ones is present.
+    std::uniform_int_distribution<int> reach(0, 1 << 30);
+    std::vector<Rectangle> rectangles;
+    for (std::size_t i = 0; i < count; ++i) {
+      rectangles.push_back({-reach(gen), -reach(gen), reach(gen), reach(gen)});
+    }
+    for (bool far : {false, true}) {
+      if (far) {
+        rectangles[gen() % count] = {1 << 30, 1 << 30, kMax, kMax};
+      }
+      RectangleBatch batch(rectangles);
+      assert(batch.size() == count);
+      for (unsigned threads : {1u, 2u, 3u, 8u}) {
+        assert(batch.intersection_area(threads) ==
+               rectangle_intersection_area(rectangles));
+        assert(same(batch.bounding_box(threads), rectangle_union(rectangles)));
+      }
+      assert((batch.intersection_area() == 0) == (far && count > 1));
+    }
+  }
+}
+
+template <typename Function>
+double nanoseconds(Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void benchmark_union_area() {
+  std::mt19937 gen(2);
+  for (std::size_t count : {1000, 10000, 100000}) {
+    auto rectangles = random_rectangles(count, 2000, 100, gen);
+    std::uint64_t sweep = 0, grid = 0;
+    double sweep_ns =
+        nanoseconds([&] { sweep = rectangle_union_area(rectangles); });
+    double grid_ns =
+        nanoseconds([&] { grid = grid_union_area(rectangles, 2000); });
+    assert(sweep == grid);
+    std::cout << count << " rectangles on a 2000x2000 grid: sweep "
+              << sweep_ns * 1e-6 << " ms, grid " << grid_ns * 1e-6
+              << " ms\n";
+  }
+  for (std::size_t count : {100000, 1000000}) {
+    auto rectangles = random_rectangles(count, 1 << 30, 1 << 20, gen);
+    std::uint64_t area = 0;
+    double ns = nanoseconds([&] { area = rectangle_union_area(rectangles); });
+    std::cout << count << " rectangles, coordinates up to 2^30: sweep "
+              << ns * 1e-6 << " ms (area " << area << ")\n";
+  }
+}
+
+void benchmark_rectangle_index() {
+  using Id = RectangleIndex::Id;
+  constexpr std::size_t kCount = 1000000;
+  constexpr std::size_t kQueries = 100000;
+  constexpr std::size_t kScans = 100;
+  std::mt19937 gen(4);
+  auto rectangles = random_rectangles(kCount, 1 << 20, 1 << 10, gen);
+  auto queries = random_rectangles(kQueries, 1 << 20, 1 << 12, gen);
+
+  RectangleIndex index;
+  double build_ns = nanoseconds([&] { index = RectangleIndex(rectangles); });
+  std::cout << kCount << " rectangles: build " << build_ns * 1e-6 << " ms, "
+            << index.memory_bytes() / (1 << 20) << " MiB\n";
+
+  std::size_t scan_found = 0, tree_found = 0;
+  double scan_ns = nanoseconds([&] {
+    for (std::size_t q = 0; q < kScans; ++q) {
+      for (const Rectangle& rectangle : rectangles) {
+        scan_found += intersects(rectangle, queries[q]);
+      }
+    }
+  });
+  for (std::size_t q = 0; q < kScans; ++q) {
+    tree_found += index.intersecting(queries[q]).size();
+  }
+  assert(scan_found == tree_found);
+
+  std::size_t found = 0;
+  double single_ns = nanoseconds([&] {
+    for (const Rectangle& query : queries) {
+      index.for_each_intersecting(query, [&](Id) { ++found; });
+    }
+  });
+  RectangleIndex::Matches matches;
+  double batch_ns =
+      nanoseconds([&] { matches = index.intersecting(queries); });
+  assert(matches.ids.size() == found);
+  // Stabbing queries: the rectangles that contain a point.
+  std::vector<Rectangle> points;
+  for (const Rectangle& query : queries) {
+    points.push_back({query.x_left, query.y_left, query.x_left, query.y_left});
+  }
+  std::size_t containing = 0;
+  double containing_ns = nanoseconds([&] {
+    for (const Rectangle& point : points) {
+      index.for_each_containing(point, [&](Id) { ++containing; });
+    }
+  });
+  std::cout << "intersecting query: linear scan " << scan_ns / kScans
+            << " ns, index " << single_ns / kQueries << " ns, batched "
+            << batch_ns / kQueries << " ns (" << found / kQueries
+            << " matches each)\n"
+            << "containing a point: index " << containing_ns / kQueries
+            << " ns (" << static_cast<double>(containing) / kQueries
+            << " matches each)\n";
+
+  std::size_t pairs = 0;
+  double pairs_ns = nanoseconds(
+      [&] { index.for_each_overlapping_pair([&](Id, Id) { ++pairs; }); });
+  std::cout << "overlapping pairs: " << pairs << " in " << pairs_ns * 1e-6
+            << " ms\n";
+
+  constexpr std::size_t kInserts = 120000;
+  constexpr std::size_t kErases = 100000;
+  auto added = random_rectangles(kInserts, 1 << 20, 1 << 10, gen);
+  double insert_ns = nanoseconds([&] {
+    for (const Rectangle& rectangle : added) {
+      index.insert(rectangle);
+    }
+  });
+  std::vector<bool> erased(kCount + kInserts, false);
+  double erase_ns = nanoseconds([&] {
+    for (std::size_t i = 0; i < kErases; ++i) {
+      Id id = static_cast<Id>(gen() % erased.size());
+      if (index.erase(id)) erased[id] = true;
+    }
+  });
+  std::cout << "insert " << insert_ns / kInserts << " ns, erase "
+            << erase_ns / kErases << " ns (amortised, with repacking)\n";
+
+  // Queries stay sublinear after the edits.
+  rectangles.insert(rectangles.end(), added.begin(), added.end());
+  scan_found = tree_found = 0;
+  for (std::size_t q = 0; q < kScans; ++q) {
+    for (std::size_t id = 0; id < rectangles.size(); ++id) {
+      scan_found += !erased[id] && intersects(rectangles[id], queries[q]);
+    }
+    tree_found += index.intersecting(queries[q]).size();
+  }
+  assert(scan_found == tree_found);
+  found = 0;
+  single_ns = nanoseconds([&] {
+    for (const Rectangle& query : queries) {
+      index.for_each_intersecting(query, [&](Id) { ++found; });
+    }
+  });
+  batch_ns = nanoseconds([&] { matches = index.intersecting(queries); });
+  assert(matches.ids.size() == found);
+  std::cout << "after " << kInserts << " inserts and " << kErases
+            << " erases: intersecting query " << single_ns / kQueries
+            << " ns, batched " << batch_ns / kQueries << " ns\n";
+}
+
+void benchmark_rectangle_batch() {
+  constexpr std::size_t kCount = 10000000;
+  std::mt19937 gen(6);
+  std::uniform_int_distribution<int> reach(0, 1 << 30);
+  std::vector<Rectangle> rectangles;
+  rectangles.reserve(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    rectangles.push_back({-reach(gen), -reach(gen), reach(gen), reach(gen)});
+  }
+  RectangleBatch batch(rectangles);
+  unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+
+  std::uint64_t area = 0, batch_area = 0;
+  double scalar_ns =
+      nanoseconds([&] { area = rectangle_intersection_area(rectangles); });
+  double batch_ns =
+      nanoseconds([&] { batch_area = batch.intersection_area(); });
+  double threaded_ns =
+      nanoseconds([&] { batch_area = batch.intersection_area(hardware); });
+  assert(area == batch_area);
+  std::cout << "intersection of " << kCount << ": vector "
+            << scalar_ns / kCount << " ns, batch " << batch_ns / kCount
+            << " ns, " << hardware << " threads " << threaded_ns / kCount
+            << " ns per rectangle\n";
+
+  Rectangle box, batch_box;
+  scalar_ns = nanoseconds([&] { box = rectangle_union(rectangles); });
+  batch_ns = nanoseconds([&] { batch_box = batch.bounding_box(); });
+  threaded_ns = nanoseconds([&] { batch_box = batch.bounding_box(hardware); });
+  assert(box.x_left == batch_box.x_left && box.y_right == batch_box.y_right);
+  std::cout << "bounding box of " << kCount << ": vector "
+            << scalar_ns / kCount << " ns, batch " << batch_ns / kCount
+            << " ns, " << hardware << " threads " << threaded_ns / kCount
+            << " ns per rectangle\n";
+
+  rectangles[1000] = {1 << 30, 1 << 30, INT32_MAX, INT32_MAX};
+  RectangleBatch disjoint(rectangles);
+  scalar_ns =
+      nanoseconds([&] { area = rectangle_intersection_area(rectangles); });
+  batch_ns = nanoseconds([&] { batch_area = disjoint.intersection_area(); });
+  assert(area == 0 && batch_area == 0);
+  std::cout << "empty after 1000: vector " << scalar_ns * 1e-3
+            << " us, batch " << batch_ns * 1e-3 << " us\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    benchmark_union_area();
+    benchmark_rectangle_index();
+    benchmark_rectangle_batch();
+    return 0;
+  }
   assert(rectangle_intersection_area({}) == 0);
   assert(rectangle_intersection_area({{0, 0, 5, 5}}) == 25);
   assert(rectangle_intersection_area({{0, 0, 4, 4}, {2, 2, 6, 6}}) == 4);
@@ -73,5 +1155,8 @@ int main() {
       rectangle_union({{1, 1, 3, 4}, {2, 0, 5, 3}, {0, 2, 4, 5}});
   assert(triple_union.x_left == 0 && triple_union.y_left == 0 &&
          triple_union.x_right == 5 && triple_union.y_right == 5);
+  test_union_area();
+  test_rectangle_index();
+  test_rectangle_batch();
   return 0;
 }
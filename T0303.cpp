@@ -1,15 +1,99 @@
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <initializer_list>
 #include <iostream>
+#include <iterator>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 class List {
  public:
   List() = default;
 
+  // Builds the list with all its nodes allocated in one batch.
+  template <typename Iterator>
+  List(Iterator begin, Iterator end) {
+    append(begin, end);
+  }
+
+  List(std::initializer_list<int> values) {
+    append(values.begin(), values.end());
+  }
+
+  List(const List& other);
+
+  List(List&& other) noexcept
+      : first(std::exchange(other.first, nullptr)),
+        last(std::exchange(other.last, nullptr)) {}
+
+  List& operator=(List other) noexcept {
+    std::swap(first, other.first);
+    std::swap(last, other.last);
+    return *this;
+  }
+
   ~List() {
     while (!empty()) {
       pop_front();
     }
   }
 
+  // Moves all of `other` to the end of this list in O(1), leaving `other`
+  // empty.
+  void splice(List& other) {
+    if (this == &other || other.empty()) {
+      return;
+    }
+    if (empty()) {
+      first = other.first;
+    } else {
+      last->next = other.first;
+    }
+    last = other.last;
+    other.first = nullptr;
+    other.last = nullptr;
+  }
+
+  // Appends [begin, end) with one allocation for all the new nodes.
+  template <typename Iterator>
+  void append(Iterator begin, Iterator end) {
+    using Category =
+        typename std::iterator_traits<Iterator>::iterator_category;
+    if constexpr (!std::is_base_of_v<std::forward_iterator_tag, Category>) {
+      // A single pass cannot be counted first.
+      std::vector<int> values(begin, end);
+      append(values.begin(), values.end());
+    } else {
+      auto count = static_cast<std::size_t>(std::distance(begin, end));
+      if (count == 0) {
+        return;
+      }
+      Chunk* chunk = new Chunk{count, new Node[count]};
+      Node* nodes = chunk->nodes;
+      for (std::size_t i = 0; i < count; ++i, ++begin) {
+        nodes[i].value = *begin;
+        nodes[i].next = i + 1 < count ? &nodes[i + 1] : nullptr;
+        nodes[i].chunk = chunk;
+      }
+      if (empty()) {
+        first = nodes;
+      } else {
+        last->next = nodes;
+      }
+      last = &nodes[count - 1];
+    }
+  }
+
   [[nodiscard]] bool empty() const { return first == nullptr; }
 
   void show() const {
@@ -22,7 +106,7 @@ class List {
   }
 
   void push_back(int new_value) {
-    Node* new_last = new Node{new_value, nullptr};
+    Node* new_last = new Node{new_value, nullptr, nullptr};
     if (empty()) {
       first = new_last;
     } else {
@@ -32,7 +116,7 @@ class List {
   }
 
   void push_front(int new_value) {
-    Node* new_first = new Node{new_value, first};
+    Node* new_first = new Node{new_value, first, nullptr};
     if (first == nullptr) {
       last = new_first;
     }
@@ -44,7 +128,7 @@ class List {
       return;
     }
     if (first == last) {
-      delete first;
+      release(first);
       first = nullptr;
       last = nullptr;
       return;
@@ -53,7 +137,7 @@ class List {
     while (cur->next != last) {
       cur = cur->next;
     }
-    delete last;
+    release(last);
     last = cur;
     last->next = nullptr;
   }
@@ -64,7 +148,7 @@ class List {
     }
     Node* old_first = first;
     first = first->next;
-    delete old_first;
+    release(old_first);
     if (first == nullptr) {
       last = nullptr;
     }
@@ -86,17 +170,786 @@ class List {
     return slow->value;
   }
 
+  // Forward iteration from the first element to the last.
+  class const_iterator;
+  [[nodiscard]] const_iterator begin() const;
+  [[nodiscard]] const_iterator end() const;
+
  private:
+  struct Chunk;
+
   struct Node {
     int value = 0;
     Node* next = nullptr;
+    // Set for nodes allocated together by append().
+    Chunk* chunk = nullptr;
   };
 
+  // Nodes allocated in one batch; freed when the last of them is.
+  struct Chunk {
+    std::size_t live;
+    Node* nodes;
+  };
+
+  static void release(Node* node) {
+    if (node->chunk == nullptr) {
+      delete node;
+    } else if (Chunk* chunk = node->chunk; --chunk->live == 0) {
+      delete[] chunk->nodes;
+      delete chunk;
+    }
+  }
+
   Node* first = nullptr;
   Node* last = nullptr;
 };
 
-int main() {
+class List::const_iterator {
+ public:
+  using iterator_category = std::forward_iterator_tag;
+  using value_type = int;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const int*;
+  using reference = const int&;
+
+  const_iterator() = default;
+  explicit const_iterator(const Node* node) : node(node) {}
+
+  reference operator*() const { return node->value; }
+  pointer operator->() const { return &node->value; }
+
+  const_iterator& operator++() {
+    node = node->next;
+    return *this;
+  }
+
+  const_iterator operator++(int) {
+    const_iterator temp = *this;
+    node = node->next;
+    return temp;
+  }
+
+  friend bool operator==(const const_iterator& left,
+                         const const_iterator& right) {
+    return left.node == right.node;
+  }
+
+  friend bool operator!=(const const_iterator& left,
+                         const const_iterator& right) {
+    return left.node != right.node;
+  }
+
+ private:
+  const Node* node = nullptr;
+};
+
+inline List::const_iterator List::begin() const {
+  return const_iterator(first);
+}
+
+inline List::const_iterator List::end() const { return const_iterator(); }
+
+inline List::List(const List& other) { append(other.begin(), other.end()); }
+
+// The same interface as List, but the nodes live in one growing vector
+// and link to each other by index, so there is no allocation per element
+// once the pool has grown, and removed nodes are reused. Links go both
+// ways, which makes pop_back() O(1), and the middle element is kept up to
+// date on every change, which makes get() O(1).
+class PooledList {
+ public:
+  PooledList() = default;
+
+  [[nodiscard]] bool empty() const { return count == 0; }
+  [[nodiscard]] std::size_t size() const { return count; }
+
+  // Makes room for `capacity` elements without growing the pool again.
+  void reserve(std::size_t capacity) { nodes.reserve(capacity); }
+
+  void show() const {
+    for (std::uint32_t cur = first; cur != kNone; cur = nodes[cur].next) {
+      std::cout << nodes[cur].value << " ";
+    }
+    std::cout << "\n";
+  }
+
+  void push_back(int new_value) {
+    std::uint32_t node = allocate(new_value, last, kNone);
+    if (empty()) {
+      first = node;
+      middle = node;
+    } else {
+      nodes[last].next = node;
+      // The middle is element size / 2; it moves right when the size
+      // becomes even.
+      if (count % 2 == 1) middle = nodes[middle].next;
+    }
+    last = node;
+    ++count;
+  }
+
+  void push_front(int new_value) {
+    std::uint32_t node = allocate(new_value, kNone, first);
+    if (empty()) {
+      last = node;
+      middle = node;
+    } else {
+      nodes[first].prev = node;
+      // Every element shifts right by one; the middle index only grows
+      // when the size becomes even, so otherwise step back.
+      if (count % 2 == 0) middle = nodes[middle].prev;
+    }
+    first = node;
+    ++count;
+  }
+
+  void pop_back() {
+    if (empty()) {
+      return;
+    }
+    if (count % 2 == 0) middle = nodes[middle].prev;
+    std::uint32_t old_last = last;
+    last = nodes[last].prev;
+    unlink(old_last);
+  }
+
+  void pop_front() {
+    if (empty()) {
+      return;
+    }
+    if (count % 2 == 1) middle = nodes[middle].next;
+    std::uint32_t old_first = first;
+    first = nodes[first].next;
+    unlink(old_first);
+  }
+
+  int get() const {
+    if (empty()) {
+      std::cout << "List is empty\n";
+      return -1;
+    }
+    return nodes[middle].value;
+  }
+
+ private:
+  static constexpr std::uint32_t kNone = UINT32_MAX;
+
+  struct Node {
+    int value = 0;
+    std::uint32_t prev = kNone;
+    std::uint32_t next = kNone;
+  };
+
+  std::uint32_t allocate(int value, std::uint32_t prev, std::uint32_t next) {
+    if (free_list == kNone) {
+      nodes.push_back({value, prev, next});
+      return static_cast<std::uint32_t>(nodes.size() - 1);
+    }
+    std::uint32_t node = free_list;
+    free_list = nodes[node].next;
+    nodes[node] = {value, prev, next};
+    return node;
+  }
+
+  // Frees `node` once first and last no longer include it.
+  void unlink(std::uint32_t node) {
+    if (--count == 0) {
+      // Nothing is linked, so the pool can start over from its beginning.
+      nodes.clear();
+      free_list = first = last = middle = kNone;
+      return;
+    }
+    nodes[first].prev = kNone;
+    nodes[last].next = kNone;
+    nodes[node].next = free_list;
+    free_list = node;
+  }
+
+  std::vector<Node> nodes;
+  std::uint32_t free_list = kNone;
+  std::uint32_t first = kNone;
+  std::uint32_t last = kNone;
+  std::uint32_t middle = kNone;
+  std::size_t count = 0;
+};
+
+// The same interface as List, stored as an unrolled list: each node is one
+// cache line holding a run of up to kBlockCapacity values, so a traversal
+// touches a new line only once every few values instead of on every hop.
+// Blocks fill from the back for push_back and from the front for
+// push_front, and a block is freed as soon as it is empty.
+class UnrolledList {
+  struct alignas(64) Block {
+    Block* prev = nullptr;
+    Block* next = nullptr;
+    // Values live in values[begin, end).
+    std::uint16_t begin = 0;
+    std::uint16_t end = 0;
+    int values[(64 - 2 * sizeof(Block*) - 2 * sizeof(std::uint16_t)) /
+               sizeof(int)];
+  };
+
+ public:
+  static constexpr std::size_t kBlockCapacity =
+      sizeof(Block::values) / sizeof(int);
+
+  UnrolledList() = default;
+  UnrolledList(const UnrolledList&) = delete;
+  UnrolledList& operator=(const UnrolledList&) = delete;
+
+  ~UnrolledList() {
+    while (first != nullptr) {
+      Block* next = first->next;
+      delete first;
+      first = next;
+    }
+  }
+
+  [[nodiscard]] bool empty() const { return count == 0; }
+  [[nodiscard]] std::size_t size() const { return count; }
+
+  void show() const {
+    for (int value : *this) {
+      std::cout << value << " ";
+    }
+    std::cout << "\n";
+  }
+
+  void push_back(int new_value) {
+    if (last == nullptr || last->end == kBlockCapacity) {
+      Block* block = new Block;
+      block->prev = last;
+      (last != nullptr ? last->next : first) = block;
+      last = block;
+    }
+    last->values[last->end++] = new_value;
+    ++count;
+  }
+
+  void push_front(int new_value) {
+    if (first == nullptr || first->begin == 0) {
+      Block* block = new Block;
+      block->begin = block->end = kBlockCapacity;
+      block->next = first;
+      (first != nullptr ? first->prev : last) = block;
+      first = block;
+    }
+    first->values[--first->begin] = new_value;
+    ++count;
+  }
+
+  void pop_back() {
+    if (empty()) {
+      return;
+    }
+    --count;
+    if (--last->end == last->begin) {
+      Block* old_last = last;
+      last = last->prev;
+      (last != nullptr ? last->next : first) = nullptr;
+      delete old_last;
+    }
+  }
+
+  void pop_front() {
+    if (empty()) {
+      return;
+    }
+    --count;
+    if (++first->begin == first->end) {
+      Block* old_first = first;
+      first = first->next;
+      (first != nullptr ? first->prev : last) = nullptr;
+      delete old_first;
+    }
+  }
+
+  // Element size / 2, like List::get(); walks whole blocks to reach it.
+  int get() const {
+    if (empty()) {
+      std::cout << "List is empty\n";
+      return -1;
+    }
+    std::size_t index = count / 2;
+    const Block* block = first;
+    while (index >= static_cast<std::size_t>(block->end - block->begin)) {
+      index -= block->end - block->begin;
+      block = block->next;
+    }
+    return block->values[block->begin + index];
+  }
+
+  template <typename Value>
+  class basic_iterator {
+   public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = int;
+    using difference_type = std::ptrdiff_t;
+    using pointer = Value*;
+    using reference = Value&;
+
+    basic_iterator() = default;
+    basic_iterator(Block* block, std::size_t index)
+        : block(block), index(index) {}
+
+    reference operator*() const { return block->values[index]; }
+    pointer operator->() const { return &block->values[index]; }
+
+    basic_iterator& operator++() {
+      if (++index == block->end) {
+        block = block->next;
+        index = block != nullptr ? block->begin : 0;
+      }
+      return *this;
+    }
+
+    basic_iterator operator++(int) {
+      basic_iterator temp = *this;
+      ++*this;
+      return temp;
+    }
+
+    friend bool operator==(const basic_iterator& left,
+                           const basic_iterator& right) {
+      return left.block == right.block && left.index == right.index;
+    }
+
+    friend bool operator!=(const basic_iterator& left,
+                           const basic_iterator& right) {
+      return !(left == right);
+    }
+
+   private:
+    Block* block = nullptr;
+    std::size_t index = 0;
+  };
+
+  using iterator = basic_iterator<int>;
+  using const_iterator = basic_iterator<const int>;
+
+  iterator begin() { return {first, first != nullptr ? first->begin : 0u}; }
+  iterator end() { return {}; }
+  [[nodiscard]] const_iterator begin() const {
+    return {first, first != nullptr ? first->begin : 0u};
+  }
+  [[nodiscard]] const_iterator end() const { return {}; }
+
+ private:
+  Block* first = nullptr;
+  Block* last = nullptr;
+  std::size_t count = 0;
+};
+
+// A FIFO for any number of producer and consumer threads: the
+// push_back/pop_front half of List, lock-free, on a fixed ring of cells
+// (Vyukov's bounded MPMC queue). Each cell has a sequence number that says
+// whose turn it is, so a thread claims a position with one compare-exchange
+// and never touches memory that another thread frees. Nothing is
+// allocated after construction.
+class ConcurrentQueue {
+ public:
+  // `capacity` is rounded up to a power of two.
+  explicit ConcurrentQueue(std::size_t capacity) {
+    std::size_t size = 2;
+    while (size < capacity) size *= 2;
+    cells = std::vector<Cell>(size);
+    mask = size - 1;
+    for (std::size_t i = 0; i < size; ++i) {
+      cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  ConcurrentQueue(const ConcurrentQueue&) = delete;
+  ConcurrentQueue& operator=(const ConcurrentQueue&) = delete;
+
+  [[nodiscard]] std::size_t capacity() const { return mask + 1; }
+
+  // Returns false, and leaves the queue unchanged, when it is full.
+  bool push_back(int new_value) {
+    std::size_t position = tail.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells[position & mask];
+      std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+      if (lag == 0) {
+        if (tail.compare_exchange_weak(position, position + 1,
+                                       std::memory_order_relaxed)) {
+          cell.value = new_value;
+          cell.sequence.store(position + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Moves the first value into `value`; returns false when there is none.
+  bool pop_front(int& value) {
+    std::size_t position = head.load(std::memory_order_relaxed);
+    for (;;) {
+      Cell& cell = cells[position & mask];
+      std::size_t sequence = cell.sequence.load(std::memory_order_acquire);
+      auto lag = static_cast<std::ptrdiff_t>(sequence - (position + 1));
+      if (lag == 0) {
+        if (head.compare_exchange_weak(position, position + 1,
+                                       std::memory_order_relaxed)) {
+          value = cell.value;
+          cell.sequence.store(position + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (lag < 0) {
+        return false;
+      } else {
+        position = head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // True if, at the moment the next cell to pop is read, no value was
+  // published in it: a pop_front() at that instant would have failed.
+  [[nodiscard]] bool empty() const {
+    std::size_t position = head.load(std::memory_order_acquire);
+    return cells[position & mask].sequence.load(std::memory_order_acquire) !=
+           position + 1;
+  }
+
+ private:
+  struct alignas(64) Cell {
+    std::atomic<std::size_t> sequence{0};
+    int value = 0;
+  };
+
+  std::vector<Cell> cells;
+  std::size_t mask = 0;
+  // Apart, so that producers and consumers do not share a cache line.
+  alignas(64) std::atomic<std::size_t> tail{0};
+  alignas(64) std::atomic<std::size_t> head{0};
+};
+
+void test_concurrent_queue() {
+  ConcurrentQueue queue(5);
+  assert(queue.capacity() == 8 && queue.empty());
+  int value = 0;
+  assert(!queue.pop_front(value));
+  for (int i = 0; i < 8; ++i) assert(queue.push_back(i));
+  assert(!queue.push_back(8) && !queue.empty());
+  for (int i = 0; i < 8; ++i) assert(queue.pop_front(value) && value == i);
+  assert(queue.empty() && !queue.pop_front(value));
+
+  // Every value is popped exactly once, and values from one producer come
+  // out in the order it pushed them.
+  const int kProducers = 3, kConsumers = 3, kPerProducer = 20000;
+  ConcurrentQueue shared(64);
+  std::vector<std::vector<int>> popped(kConsumers);
+  std::atomic<int> remaining{kProducers * kPerProducer};
+  std::vector<std::thread> threads;
+  for (int p = 0; p < kProducers; ++p) {
+    threads.emplace_back([&, p] {
+      for (int i = 0; i < kPerProducer; ++i) {
+        while (!shared.push_back(p * kPerProducer + i)) {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (int c = 0; c < kConsumers; ++c) {
+    threads.emplace_back([&, c] {
+      int item = 0;
+      while (remaining.load() > 0) {
+        if (shared.pop_front(item)) {
+          popped[c].push_back(item);
+          remaining.fetch_sub(1);
+        } else {
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  assert(shared.empty());
+  std::vector<int> seen(kProducers * kPerProducer, 0);
+  for (const std::vector<int>& items : popped) {
+    std::vector<int> last(kProducers, -1);
+    for (int item : items) {
+      ++seen[item];
+      assert(item > last[item / kPerProducer]);
+      last[item / kPerProducer] = item;
+    }
+  }
+  assert(std::all_of(seen.begin(), seen.end(), [](int n) { return n == 1; }));
+}
+
+void test_list_moves() {
+  auto values = [](const List& list) {
+    return std::vector<int>(list.begin(), list.end());
+  };
+  List bulk = {1, 2, 3, 4, 5};
+  assert(values(bulk) == std::vector<int>({1, 2, 3, 4, 5}));
+  assert(bulk.get() == 3);
+
+  // Nodes of one batch are freed one by one, mixed with single nodes.
+  bulk.push_front(0);
+  bulk.push_back(6);
+  bulk.pop_back();
+  bulk.pop_back();
+  bulk.pop_front();
+  assert(values(bulk) == std::vector<int>({1, 2, 3, 4}));
+
+  List copy = bulk;
+  copy.push_back(7);
+  assert(values(bulk) == std::vector<int>({1, 2, 3, 4}));
+  List moved = std::move(copy);
+  assert(copy.empty() && values(moved) == std::vector<int>({1, 2, 3, 4, 7}));
+  copy = moved;
+  moved = List{9};
+  assert(values(copy) == std::vector<int>({1, 2, 3, 4, 7}));
+  copy = copy;
+  assert(values(copy) == std::vector<int>({1, 2, 3, 4, 7}));
+
+  moved.splice(copy);
+  assert(copy.empty() && values(moved) == std::vector<int>({9, 1, 2, 3, 4, 7}));
+  moved.splice(moved);
+  copy.splice(moved);
+  assert(moved.empty() && values(copy).size() == 6);
+  copy.push_back(8);
+  assert(values(copy).back() == 8);
+
+  std::istringstream stream("5 6 7");
+  List read{std::istream_iterator<int>(stream), std::istream_iterator<int>()};
+  read.append(bulk.begin(), bulk.end());
+  assert(values(read) == std::vector<int>({5, 6, 7, 1, 2, 3, 4}));
+  List empty(bulk.end(), bulk.end());
+  assert(empty.empty());
+}
+
+// Runs the same random operations on every list and on std::deque.
+void test_pooled_list() {
+  std::mt19937 gen(1);
+  List list;
+  PooledList pooled;
+  UnrolledList unrolled;
+  std::deque<int> expected;
+  for (int step = 0; step < 200000; ++step) {
+    int value = static_cast<int>(gen() % 1000);
+    // Grow and shrink in phases, so that the lists often become empty.
+    bool grow = (step / 1000) % 2 == 0;
+    switch (gen() % 4) {
+      case 0:
+        if (grow || gen() % 3 == 0) {
+          list.push_back(value);
+          pooled.push_back(value);
+          unrolled.push_back(value);
+          expected.push_back(value);
+        }
+        break;
+      case 1:
+        if (grow || gen() % 3 == 0) {
+          list.push_front(value);
+          pooled.push_front(value);
+          unrolled.push_front(value);
+          expected.push_front(value);
+        }
+        break;
+      case 2:
+        list.pop_back();
+        pooled.pop_back();
+        unrolled.pop_back();
+        if (!expected.empty()) expected.pop_back();
+        break;
+      default:
+        list.pop_front();
+        pooled.pop_front();
+        unrolled.pop_front();
+        if (!expected.empty()) expected.pop_front();
+        break;
+    }
+    assert(pooled.empty() == expected.empty());
+    assert(pooled.size() == expected.size());
+    assert(unrolled.size() == expected.size());
+    if (!expected.empty()) {
+      assert(pooled.get() == expected[expected.size() / 2]);
+      assert(unrolled.get() == expected[expected.size() / 2]);
+      if (step % 97 == 0) assert(list.get() == pooled.get());
+    }
+    if (step % 89 == 0) {
+      assert(std::equal(list.begin(), list.end(), expected.begin(),
+                        expected.end()));
+      assert(std::equal(unrolled.begin(), unrolled.end(), expected.begin(),
+                        expected.end()));
+    }
+  }
+}
+
+template <typename Function>
+double nanoseconds(Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Times push_back, get(), pop_back and pop_front at 10^7 elements. List's
+// get() and pop_back() walk the list, so they are timed on a few calls.
+template <typename ListType>
+void benchmark_list(const char* name) {
+  const int kCount = 10000000;
+  const int kWalks = 10;
+  ListType list;
+  double push_ns = nanoseconds([&] {
+    for (int i = 0; i < kCount; ++i) list.push_back(i);
+  });
+  volatile int sink = 0;
+  double get_ns = nanoseconds([&] {
+    for (int i = 0; i < kWalks; ++i) sink = sink + list.get();
+  });
+  double pop_back_ns = nanoseconds([&] {
+    for (int i = 0; i < kWalks; ++i) list.pop_back();
+  });
+  double pop_front_ns = nanoseconds([&] {
+    while (!list.empty()) list.pop_front();
+  });
+  std::cout << name << ": push_back " << push_ns / kCount << " ns, get "
+            << get_ns / kWalks << " ns, pop_back " << pop_back_ns / kWalks
+            << " ns, pop_front " << pop_front_ns / (kCount - kWalks)
+            << " ns\n";
+}
+
+// List behind one mutex, the way it was shared between threads before
+// ConcurrentQueue.
+class LockedList {
+ public:
+  bool push_back(int new_value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    list.push_back(new_value);
+    return true;
+  }
+
+  bool pop_front(int& value) {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (list.empty()) return false;
+    value = *list.begin();
+    list.pop_front();
+    return true;
+  }
+
+ private:
+  std::mutex mutex;
+  List list;
+};
+
+// Moves kItems values from `producers` threads to `consumers` threads and
+// returns the operations (pushes plus pops) per second.
+template <typename Queue>
+double queue_throughput(Queue& queue, int producers, int consumers) {
+  const int kItems = 2000000;
+  std::atomic<int> remaining{kItems};
+  std::vector<std::thread> threads;
+  double ns = nanoseconds([&] {
+    for (int p = 0; p < producers; ++p) {
+      threads.emplace_back([&, p] {
+        int begin = kItems / producers * p;
+        int end = p + 1 == producers ? kItems : begin + kItems / producers;
+        for (int i = begin; i < end; ++i) {
+          while (!queue.push_back(i)) std::this_thread::yield();
+        }
+      });
+    }
+    for (int c = 0; c < consumers; ++c) {
+      threads.emplace_back([&] {
+        int item = 0;
+        while (remaining.load(std::memory_order_relaxed) > 0) {
+          if (queue.pop_front(item)) {
+            remaining.fetch_sub(1, std::memory_order_relaxed);
+          } else {
+            std::this_thread::yield();
+          }
+        }
+      });
+    }
+    for (std::thread& thread : threads) thread.join();
+  });
+  return 2.0 * kItems / (ns * 1e-9);
+}
+
+void benchmark_queue() {
+  for (int threads : {1, 2, 4}) {
+    ConcurrentQueue queue(1 << 16);
+    LockedList locked;
+    double lock_free = queue_throughput(queue, threads, threads);
+    double with_mutex = queue_throughput(locked, threads, threads);
+    std::cout << threads << " producers, " << threads
+              << " consumers: ConcurrentQueue " << lock_free / 1e6
+              << " Mops/s, mutex + List " << with_mutex / 1e6
+              << " Mops/s (hardware threads: "
+              << std::thread::hardware_concurrency() << ")\n";
+  }
+}
+
+// Building 10^7 elements with push_back against one bulk construction, and
+// merging two such lists by copying against splice.
+void benchmark_bulk() {
+  const int kCount = 10000000;
+  std::vector<int> values(kCount);
+  for (int i = 0; i < kCount; ++i) values[i] = i;
+  double push_ns = nanoseconds([&] {
+    List list;
+    for (int value : values) list.push_back(value);
+  });
+  double bulk_ns =
+      nanoseconds([&] { List list(values.begin(), values.end()); });
+  List left(values.begin(), values.end()), right(values.begin(), values.end());
+  double copy_ns =
+      nanoseconds([&] { left.append(right.begin(), right.end()); });
+  List spliced(values.begin(), values.end());
+  double splice_ns = nanoseconds([&] { spliced.splice(right); });
+  std::cout << "build 10^7 + destroy: push_back " << push_ns * 1e-6
+            << " ms, bulk " << bulk_ns * 1e-6 << " ms; merge: copy "
+            << copy_ns * 1e-6 << " ms, splice " << splice_ns << " ns\n";
+}
+
+// Sums 10^7 values through the iterators, after the lists were built with
+// some unrelated allocations in between, as in a long-running program.
+void benchmark_scan() {
+  const int kCount = 10000000;
+  List list;
+  UnrolledList unrolled;
+  std::vector<std::vector<char>> noise;
+  for (int i = 0; i < kCount; ++i) {
+    list.push_back(i);
+    unrolled.push_back(i);
+    if (i % 16 == 0) noise.emplace_back(24);
+  }
+  long long list_sum = 0, unrolled_sum = 0;
+  double list_ns = nanoseconds([&] {
+    for (int value : list) list_sum += value;
+  });
+  double unrolled_ns = nanoseconds([&] {
+    for (int value : unrolled) unrolled_sum += value;
+  });
+  assert(list_sum == unrolled_sum);
+  std::cout << "scan: List " << list_ns / kCount << " ns/element, "
+            << "UnrolledList " << unrolled_ns / kCount << " ns/element (x"
+            << list_ns / unrolled_ns << ")\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    benchmark_list<List>("List");
+    benchmark_list<PooledList>("PooledList");
+    benchmark_list<UnrolledList>("UnrolledList");
+    benchmark_scan();
+    benchmark_queue();
+    benchmark_bulk();
+    return 0;
+  }
+  test_pooled_list();
+  test_concurrent_queue();
+  test_list_moves();
+
   List list;
   std::cout << list.empty() << "\n";
   list.push_back(1);
@@ -1,10 +1,24 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cmath>
+#include <cstddef>
 #include <iostream>
+#include <limits>
 #include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <variant>
 #include <vector>
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
 class Shape {
  public:
   virtual ~Shape() = default;
@@ -12,7 +26,7 @@ class Shape {
   [[nodiscard]] virtual double area() const = 0;
 };
 
-class Circle final : Shape {
+class Circle final : public Shape {
   double radius;
 
  public:
@@ -57,6 +71,399 @@ class Triangle : public Polygon {
   }
 };
 
+// A few doubles handled as one value: four with AVX2, two with SSE2, or
+// just one. The batch kernels are written once against it. They are not
+// left to the auto-vectoriser, which will not vectorise std::sqrt while it
+// may have to set errno.
+struct Pack {
+#if defined(__AVX2__)
+  static constexpr std::size_t kWidth = 4;
+  __m256d value;
+
+  Pack(__m256d v) : value(v) {}
+  Pack(double x) : value(_mm256_set1_pd(x)) {}
+  static Pack load(const double* p) { return _mm256_loadu_pd(p); }
+  void store(double* p) const { _mm256_storeu_pd(p, value); }
+  friend Pack operator+(Pack a, Pack b) {
+    return _mm256_add_pd(a.value, b.value);
+  }
+  friend Pack operator-(Pack a, Pack b) {
+    return _mm256_sub_pd(a.value, b.value);
+  }
+  friend Pack operator*(Pack a, Pack b) {
+    return _mm256_mul_pd(a.value, b.value);
+  }
+  friend Pack operator/(Pack a, Pack b) {
+    return _mm256_div_pd(a.value, b.value);
+  }
+  friend Pack sqrt(Pack a) { return _mm256_sqrt_pd(a.value); }
+#elif defined(__SSE2__)
+  static constexpr std::size_t kWidth = 2;
+  __m128d value;
+
+  Pack(__m128d v) : value(v) {}
+  Pack(double x) : value(_mm_set1_pd(x)) {}
+  static Pack load(const double* p) { return _mm_loadu_pd(p); }
+  void store(double* p) const { _mm_storeu_pd(p, value); }
+  friend Pack operator+(Pack a, Pack b) { return _mm_add_pd(a.value, b.value); }
+  friend Pack operator-(Pack a, Pack b) { return _mm_sub_pd(a.value, b.value); }
+  friend Pack operator*(Pack a, Pack b) { return _mm_mul_pd(a.value, b.value); }
+  friend Pack operator/(Pack a, Pack b) { return _mm_div_pd(a.value, b.value); }
+  friend Pack sqrt(Pack a) { return _mm_sqrt_pd(a.value); }
+#else
+  static constexpr std::size_t kWidth = 1;
+  double value;
+
+  Pack(double x) : value(x) {}
+  static Pack load(const double* p) { return *p; }
+  void store(double* p) const { *p = value; }
+  friend Pack operator+(Pack a, Pack b) { return a.value + b.value; }
+  friend Pack operator-(Pack a, Pack b) { return a.value - b.value; }
+  friend Pack operator*(Pack a, Pack b) { return a.value * b.value; }
+  friend Pack operator/(Pack a, Pack b) { return a.value / b.value; }
+  friend Pack sqrt(Pack a) { return std::sqrt(a.value); }
+#endif
+};
+
+template <typename Value>
+Value load(const double* p) {
+  if constexpr (std::is_same_v<Value, Pack>) {
+    return Pack::load(p);
+  } else {
+    return *p;
+  }
+}
+
+inline void store(double* p, double x) { *p = x; }
+inline void store(double* p, Pack x) { x.store(p); }
+
+// Calls kernel(i, Pack()) for whole packs and kernel(i, double()) for the
+// rest; the second argument only selects the type to compute with.
+template <typename Kernel>
+void for_each_pack(std::size_t count, Kernel kernel) {
+  std::size_t i = 0;
+  for (; i + Pack::kWidth <= count; i += Pack::kWidth) kernel(i, Pack(0.0));
+  for (; i < count; ++i) kernel(i, 0.0);
+}
+
+// Batch kernels over plain arrays: out[i] is the area or perimeter of
+// shape i, computed with the same operations in the same order as the
+// matching Shape class, so the results are identical.
+void circle_areas(const double* radius, std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    auto r = load<decltype(lanes)>(radius + i);
+    store(out + i, M_PI * r * r);
+  });
+}
+
+void circle_perimeters(const double* radius, std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    store(out + i, 2 * M_PI * load<decltype(lanes)>(radius + i));
+  });
+}
+
+void rectangle_areas(const double* width, const double* height,
+                     std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    using Value = decltype(lanes);
+    store(out + i, load<Value>(width + i) * load<Value>(height + i));
+  });
+}
+
+void rectangle_perimeters(const double* width, const double* height,
+                          std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    using Value = decltype(lanes);
+    store(out + i, 2 * (load<Value>(width + i) + load<Value>(height + i)));
+  });
+}
+
+void triangle_perimeters(const double* a, const double* b, const double* c,
+                         std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    using Value = decltype(lanes);
+    store(out + i,
+          load<Value>(a + i) + load<Value>(b + i) + load<Value>(c + i));
+  });
+}
+
+// Heron's formula.
+void triangle_areas(const double* a, const double* b, const double* c,
+                    std::size_t count, double* out) {
+  for_each_pack(count, [&](std::size_t i, auto lanes) {
+    using Value = decltype(lanes);
+    using std::sqrt;
+    Value x = load<Value>(a + i);
+    Value y = load<Value>(b + i);
+    Value z = load<Value>(c + i);
+    Value s = (x + y + z) / 2;
+    store(out + i, sqrt(s * (s - x) * (s - y) * (s - z)));
+  });
+}
+
+// Shapes kept by kind in separate contiguous arrays (structure of arrays)
+// instead of one heap object each, so that a batch kernel streams through
+// each kind. Squares are stored as rectangles. Shapes are numbered in the
+// order circles, rectangles, triangles.
+class ShapeStore {
+ public:
+  void add_circle(double radius) { radii.push_back(radius); }
+
+  void add_rectangle(double width, double height) {
+    widths.push_back(width);
+    heights.push_back(height);
+  }
+
+  void add_square(double side) { add_rectangle(side, side); }
+
+  void add_triangle(double side1, double side2, double side3) {
+    sides_a.push_back(side1);
+    sides_b.push_back(side2);
+    sides_c.push_back(side3);
+  }
+
+  void reserve(std::size_t circles, std::size_t rectangles,
+               std::size_t triangles) {
+    radii.reserve(circles);
+    widths.reserve(rectangles);
+    heights.reserve(rectangles);
+    sides_a.reserve(triangles);
+    sides_b.reserve(triangles);
+    sides_c.reserve(triangles);
+  }
+
+  [[nodiscard]] std::size_t size() const {
+    return radii.size() + widths.size() + sides_a.size();
+  }
+
+  // Fills out[0, size()) with the area of every shape.
+  void areas(double* out) const {
+    circle_areas(radii.data(), radii.size(), out);
+    out += radii.size();
+    rectangle_areas(widths.data(), heights.data(), widths.size(), out);
+    out += widths.size();
+    triangle_areas(sides_a.data(), sides_b.data(), sides_c.data(),
+                   sides_a.size(), out);
+  }
+
+  void perimeters(double* out) const {
+    circle_perimeters(radii.data(), radii.size(), out);
+    out += radii.size();
+    rectangle_perimeters(widths.data(), heights.data(), widths.size(), out);
+    out += widths.size();
+    triangle_perimeters(sides_a.data(), sides_b.data(), sides_c.data(),
+                        sides_a.size(), out);
+  }
+
+  // Sums over all shapes, split across `threads` threads. The result only
+  // depends on the number of threads, not on their timing.
+  [[nodiscard]] double total_area(unsigned threads = 1) const {
+    return reduce(threads, true);
+  }
+
+  [[nodiscard]] double total_perimeter(unsigned threads = 1) const {
+    return reduce(threads, false);
+  }
+
+ private:
+  std::vector<double> radii;
+  std::vector<double> widths, heights;
+  std::vector<double> sides_a, sides_b, sides_c;
+
+  // Computes areas or perimeters of shapes [begin, end) into `out`.
+  void range(std::size_t begin, std::size_t end, double* out,
+             bool area) const {
+    auto clip = [&](std::size_t offset, std::size_t count) {
+      std::size_t from = std::clamp(begin, offset, offset + count);
+      std::size_t to = std::clamp(end, offset, offset + count);
+      return std::make_pair(from - offset, to - from);
+    };
+    auto [circle, circles] = clip(0, radii.size());
+    if (area) {
+      circle_areas(radii.data() + circle, circles, out);
+    } else {
+      circle_perimeters(radii.data() + circle, circles, out);
+    }
+    out += circles;
+    auto [rectangle, rectangles] = clip(radii.size(), widths.size());
+    if (area) {
+      rectangle_areas(widths.data() + rectangle, heights.data() + rectangle,
+                      rectangles, out);
+    } else {
+      rectangle_perimeters(widths.data() + rectangle,
+                           heights.data() + rectangle, rectangles, out);
+    }
+    out += rectangles;
+    auto [triangle, triangles] =
+        clip(radii.size() + widths.size(), sides_a.size());
+    if (area) {
+      triangle_areas(sides_a.data() + triangle, sides_b.data() + triangle,
+                     sides_c.data() + triangle, triangles, out);
+    } else {
+      triangle_perimeters(sides_a.data() + triangle, sides_b.data() + triangle,
+                          sides_c.data() + triangle, triangles, out);
+    }
+  }
+
+  // Each thread takes one contiguous part of the shapes and runs the
+  // kernels over it a block at a time, so no output array is needed.
+  double reduce(unsigned threads, bool area) const {
+    constexpr std::size_t kBlock = 1024;
+    threads = std::max(1u, threads);
+    std::vector<double> partial(threads, 0.0);
+    auto work = [&](unsigned part) {
+      std::size_t begin = size() * part / threads;
+      std::size_t end = size() * (part + 1) / threads;
+      double values[kBlock];
+      // Independent sums, so that the additions do not wait on each other.
+      double sums[4] = {0, 0, 0, 0};
+      for (std::size_t block = begin; block < end; block += kBlock) {
+        std::size_t count = std::min(kBlock, end - block);
+        range(block, block + count, values, area);
+        std::fill(values + count, values + (count + 3) / 4 * 4, 0.0);
+        for (std::size_t i = 0; i < count; i += 4) {
+          for (int lane = 0; lane < 4; ++lane) sums[lane] += values[i + lane];
+        }
+      }
+      partial[part] = (sums[0] + sums[1]) + (sums[2] + sums[3]);
+    };
+    std::vector<std::thread> workers;
+    for (unsigned part = 1; part < threads; ++part) {
+      workers.emplace_back(work, part);
+    }
+    work(0);
+    for (std::thread& worker : workers) worker.join();
+    double total = 0;
+    for (double sum : partial) total += sum;
+    return total;
+  }
+};
+
+// std::sqrt that can also run in constant expressions. GCC folds its
+// builtin exactly, correctly rounded; elsewhere Newton's method is used at
+// compile time and may be one ulp off.
+constexpr double constexpr_sqrt(double x) {
+#if defined(__GNUC__) && !defined(__clang__)
+  return __builtin_sqrt(x);
+#else
+  if (!__builtin_is_constant_evaluated()) return std::sqrt(x);
+  if (!(x >= 0)) return std::numeric_limits<double>::quiet_NaN();
+  if (x == 0 || x == std::numeric_limits<double>::infinity()) return x;
+  double y = x > 1 ? x : 1;
+  for (;;) {
+    double next = (y + x / y) / 2;
+    if (next >= y) return y;
+    y = next;
+  }
+#endif
+}
+
+// The shapes as a closed set of plain values, stored inline in a
+// std::variant instead of behind a pointer. Each has the same area() and
+// perimeter() as the matching class, and everything is constexpr.
+struct CircleValue {
+  double radius;
+
+  [[nodiscard]] constexpr double perimeter() const { return 2 * M_PI * radius; }
+  [[nodiscard]] constexpr double area() const { return M_PI * radius * radius; }
+};
+
+struct RectangleValue {
+  double width;
+  double height;
+
+  [[nodiscard]] constexpr double perimeter() const {
+    return 2 * (width + height);
+  }
+  [[nodiscard]] constexpr double area() const { return width * height; }
+};
+
+struct SquareValue {
+  double side;
+
+  [[nodiscard]] constexpr double perimeter() const {
+    return RectangleValue{side, side}.perimeter();
+  }
+  [[nodiscard]] constexpr double area() const {
+    return RectangleValue{side, side}.area();
+  }
+};
+
+struct TriangleValue {
+  double a, b, c;
+
+  [[nodiscard]] constexpr double perimeter() const { return a + b + c; }
+  [[nodiscard]] constexpr double area() const {
+    double s = perimeter() / 2;
+    return constexpr_sqrt(s * (s - a) * (s - b) * (s - c));
+  }
+};
+
+using ShapeValue =
+    std::variant<CircleValue, RectangleValue, SquareValue, TriangleValue>;
+
+constexpr double perimeter(const ShapeValue& shape) {
+  return std::visit([](const auto& value) { return value.perimeter(); },
+                    shape);
+}
+
+constexpr double area(const ShapeValue& shape) {
+  return std::visit([](const auto& value) { return value.area(); }, shape);
+}
+
+// Bump allocation for Shape objects that still need the virtual
+// interface: objects are placed one after another in large blocks, and
+// all of them are destroyed together with the arena or by reset().
+class ShapeArena {
+ public:
+  ShapeArena() = default;
+  ShapeArena(const ShapeArena&) = delete;
+  ShapeArena& operator=(const ShapeArena&) = delete;
+  ~ShapeArena() { reset(); }
+
+  template <typename T, typename... Args>
+  T* make(Args&&... args) {
+    static_assert(std::is_base_of_v<Shape, T>);
+    static_assert(sizeof(T) <= kBlockSize && alignof(T) <= kBlockAlignment);
+    std::size_t offset = (used + alignof(T) - 1) / alignof(T) * alignof(T);
+    if (blocks_in_use == 0 || offset + sizeof(T) > kBlockSize) {
+      if (blocks_in_use == blocks.size()) {
+        blocks.push_back(std::make_unique<Block>());
+      }
+      ++blocks_in_use;
+      offset = 0;
+    }
+    T* shape = new (blocks[blocks_in_use - 1]->bytes + offset)
+        T(std::forward<Args>(args)...);
+    used = offset + sizeof(T);
+    shapes.push_back(shape);
+    return shape;
+  }
+
+  [[nodiscard]] std::size_t size() const { return shapes.size(); }
+
+  // Destroys every shape; the blocks are kept for reuse.
+  void reset() {
+    for (Shape* shape : shapes) shape->~Shape();
+    shapes.clear();
+    blocks_in_use = 0;
+    used = 0;
+  }
+
+ private:
+  static constexpr std::size_t kBlockSize = 64 * 1024;
+  static constexpr std::size_t kBlockAlignment = alignof(std::max_align_t);
+
+  struct Block {
+    alignas(kBlockAlignment) std::byte bytes[kBlockSize];
+  };
+
+  std::vector<std::unique_ptr<Block>> blocks;
+  std::size_t blocks_in_use = 0;
+  std::size_t used = 0;
+  std::vector<Shape*> shapes;
+};
+
 void demonstrate_polymorphism() {
   std::vector<std::unique_ptr<Shape>> shapes;
   shapes.push_back(std::make_unique<Circle>(5.0));
@@ -90,8 +497,257 @@ void test_shapes() {
   assert(std::abs(rectPtr->area() - 16.0) < 0.0001);
 }
 
-int main() {
+void test_shape_store() {
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> length(0.5, 10.0);
+  std::vector<std::unique_ptr<Shape>> shapes;
+  ShapeStore store;
+  // Built in store order, so that shape i is the same in both.
+  for (int i = 0; i < 1001; ++i) {
+    double r = length(gen);
+    shapes.push_back(std::make_unique<Circle>(r));
+    store.add_circle(r);
+  }
+  for (int i = 0; i < 777; ++i) {
+    double w = length(gen), h = length(gen);
+    if (i % 3 == 0) {
+      shapes.push_back(std::make_unique<Square>(w));
+      store.add_square(w);
+    } else {
+      shapes.push_back(std::make_unique<Rectangle>(w, h));
+      store.add_rectangle(w, h);
+    }
+  }
+  for (int i = 0; i < 1235; ++i) {
+    // Some side triples break the triangle inequality; both give NaN.
+    double a = length(gen), b = length(gen), c = length(gen);
+    shapes.push_back(std::make_unique<Triangle>(a, b, c));
+    store.add_triangle(a, b, c);
+  }
+  assert(store.size() == shapes.size());
+  std::vector<double> areas(store.size()), perimeters(store.size());
+  store.areas(areas.data());
+  store.perimeters(perimeters.data());
+  double total_area = 0, total_perimeter = 0;
+  for (std::size_t i = 0; i < shapes.size(); ++i) {
+    double area = shapes[i]->area();
+    assert(areas[i] == area || (std::isnan(areas[i]) && std::isnan(area)));
+    assert(perimeters[i] == shapes[i]->perimeter());
+    if (!std::isnan(area)) total_area += area;
+    total_perimeter += perimeters[i];
+  }
+  assert(std::isnan(store.total_area()));
+  for (unsigned threads : {1u, 2u, 3u, 8u}) {
+    assert(std::abs(store.total_perimeter(threads) - total_perimeter) <
+           1e-9 * total_perimeter);
+  }
+
+  ShapeStore valid;
+  valid.add_triangle(3.0, 4.0, 5.0);
+  valid.add_square(4.0);
+  valid.add_circle(1.0);
+  assert(std::abs(valid.total_area(2) - (6.0 + 16.0 + M_PI)) < 1e-12);
+  assert(ShapeStore().total_area(4) == 0);
+}
+
+void test_shape_values() {
+  static_assert(area(RectangleValue{4.0, 5.0}) == 20.0);
+  static_assert(perimeter(SquareValue{4.0}) == 16.0);
+  static_assert(area(TriangleValue{3.0, 4.0, 5.0}) == 6.0);
+  static_assert(perimeter(CircleValue{1.0}) == 2 * M_PI);
+  static_assert(constexpr_sqrt(2.0) > 1.4142135 &&
+                constexpr_sqrt(2.0) < 1.4142136);
+  constexpr ShapeValue kUnitCircle = CircleValue{1.0};
+  static_assert(area(kUnitCircle) == M_PI);
+
+  std::mt19937 gen(3);
+  std::uniform_real_distribution<double> length(0.5, 10.0);
+  ShapeArena arena;
+  std::vector<Shape*> shapes;
+  std::vector<ShapeValue> values;
+  for (int round = 0; round < 3; ++round) {
+    for (int i = 0; i < 10000; ++i) {
+      double a = length(gen), b = length(gen), c = length(gen);
+      switch (i % 4) {
+        case 0:
+          shapes.push_back(arena.make<Circle>(a));
+          values.push_back(CircleValue{a});
+          break;
+        case 1:
+          shapes.push_back(arena.make<Rectangle>(a, b));
+          values.push_back(RectangleValue{a, b});
+          break;
+        case 2:
+          shapes.push_back(arena.make<Square>(a));
+          values.push_back(SquareValue{a});
+          break;
+        default:
+          shapes.push_back(arena.make<Triangle>(a, b, c));
+          values.push_back(TriangleValue{a, b, c});
+          break;
+      }
+    }
+    assert(arena.size() == shapes.size());
+    for (std::size_t i = 0; i < shapes.size(); ++i) {
+      assert(reinterpret_cast<std::uintptr_t>(shapes[i]) % alignof(Triangle) ==
+             0);
+      double expected = shapes[i]->area();
+      assert(area(values[i]) == expected ||
+             (std::isnan(expected) && std::isnan(area(values[i]))));
+      assert(perimeter(values[i]) == shapes[i]->perimeter());
+    }
+    arena.reset();
+    shapes.clear();
+    values.clear();
+  }
+}
+
+template <typename Function>
+double nanoseconds(Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Total area and perimeter of 10^7 shapes through virtual calls and
+// through ShapeStore.
+void benchmark_shape_store() {
+  const int kShapes = 10000000;
+  std::mt19937 gen(2);
+  std::uniform_real_distribution<double> length(1.0, 10.0);
+  std::vector<std::unique_ptr<Shape>> shapes;
+  ShapeStore store;
+  for (int i = 0; i < kShapes; ++i) {
+    double a = length(gen), b = length(gen);
+    switch (gen() % 4) {
+      case 0:
+        shapes.push_back(std::make_unique<Circle>(a));
+        store.add_circle(a);
+        break;
+      case 1:
+        shapes.push_back(std::make_unique<Rectangle>(a, b));
+        store.add_rectangle(a, b);
+        break;
+      case 2:
+        shapes.push_back(std::make_unique<Square>(a));
+        store.add_square(a);
+        break;
+      default:
+        // Sides that always form a triangle.
+        shapes.push_back(std::make_unique<Triangle>(a, b, a + b - 0.5));
+        store.add_triangle(a, b, a + b - 0.5);
+        break;
+    }
+  }
+  double virtual_total = 0;
+  double virtual_ns = nanoseconds([&] {
+    for (const auto& shape : shapes) {
+      virtual_total += shape->area() + shape->perimeter();
+    }
+  });
+  std::cout << "virtual calls: " << virtual_ns / kShapes << " ns/shape\n";
+  unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned threads = 1; threads <= max_threads; threads *= 2) {
+    double total = 0;
+    double ns = nanoseconds([&] {
+      total = store.total_area(threads) + store.total_perimeter(threads);
+    });
+    assert(std::abs(total - virtual_total) < 1e-9 * virtual_total);
+    std::cout << "ShapeStore, " << threads << " threads: " << ns / kShapes
+              << " ns/shape (x" << virtual_ns / ns << ")\n";
+  }
+}
+
+// Creating 10^6 shapes and summing their areas and perimeters: one heap
+// object each, arena objects, and inline variants.
+void benchmark_shape_values() {
+  const int kShapes = 1000000;
+  std::mt19937 gen(4);
+  std::uniform_real_distribution<double> length(1.0, 10.0);
+  std::vector<double> sides(3 * kShapes);
+  for (double& side : sides) side = length(gen);
+
+  double heap_total = 0, arena_total = 0, value_total = 0;
+  std::vector<std::unique_ptr<Shape>> heap;
+  double heap_make_ns = nanoseconds([&] {
+    for (int i = 0; i < kShapes; ++i) {
+      const double* s = &sides[3 * i];
+      if (i % 3 == 0) {
+        heap.push_back(std::make_unique<Circle>(s[0]));
+      } else if (i % 3 == 1) {
+        heap.push_back(std::make_unique<Rectangle>(s[0], s[1]));
+      } else {
+        heap.push_back(
+            std::make_unique<Triangle>(s[0], s[1], s[0] + s[1] - 0.5));
+      }
+    }
+  });
+  double heap_sum_ns = nanoseconds([&] {
+    for (const auto& shape : heap) {
+      heap_total += shape->area() + shape->perimeter();
+    }
+  });
+
+  ShapeArena arena;
+  std::vector<Shape*> in_arena;
+  double arena_make_ns = nanoseconds([&] {
+    for (int i = 0; i < kShapes; ++i) {
+      const double* s = &sides[3 * i];
+      if (i % 3 == 0) {
+        in_arena.push_back(arena.make<Circle>(s[0]));
+      } else if (i % 3 == 1) {
+        in_arena.push_back(arena.make<Rectangle>(s[0], s[1]));
+      } else {
+        in_arena.push_back(arena.make<Triangle>(s[0], s[1], s[0] + s[1] - 0.5));
+      }
+    }
+  });
+  double arena_sum_ns = nanoseconds([&] {
+    for (const Shape* shape : in_arena) {
+      arena_total += shape->area() + shape->perimeter();
+    }
+  });
+
+  std::vector<ShapeValue> values;
+  double value_make_ns = nanoseconds([&] {
+    for (int i = 0; i < kShapes; ++i) {
+      const double* s = &sides[3 * i];
+      if (i % 3 == 0) {
+        values.push_back(CircleValue{s[0]});
+      } else if (i % 3 == 1) {
+        values.push_back(RectangleValue{s[0], s[1]});
+      } else {
+        values.push_back(TriangleValue{s[0], s[1], s[0] + s[1] - 0.5});
+      }
+    }
+  });
+  double value_sum_ns = nanoseconds([&] {
+    for (const ShapeValue& shape : values) {
+      value_total += area(shape) + perimeter(shape);
+    }
+  });
+  assert(heap_total == arena_total && heap_total == value_total);
+
+  auto report = [](const char* name, double make_ns, double sum_ns) {
+    std::cout << name << ": make " << make_ns / kShapes << " ns/shape, sum "
+              << sum_ns / kShapes << " ns/shape\n";
+  };
+  report("make_unique", heap_make_ns, heap_sum_ns);
+  report("ShapeArena", arena_make_ns, arena_sum_ns);
+  report("ShapeValue", value_make_ns, value_sum_ns);
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    benchmark_shape_store();
+    benchmark_shape_values();
+    return 0;
+  }
   demonstrate_polymorphism();
   test_shapes();
+  test_shape_store();
+  test_shape_values();
   return 0;
 }
@@ -1,74 +1,122 @@
+#include <algorithm>
 #include <array>
 #include <cassert>
+#include <charconv>
+#include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
 #include <sstream>
 #include <string>
+#include <system_error>
+#include <vector>
+
+#ifdef __SSSE3__
+#include <tmmintrin.h>
+#endif
+
+// Decimal text of every octet value, for IPv4 formatting.
+struct OctetText {
+  char digits[3];
+  std::uint8_t length;
+};
+
+constexpr std::array<OctetText, 256> kOctetText = [] {
+  std::array<OctetText, 256> table{};
+  for (int value = 0; value < 256; ++value) {
+    OctetText& text = table[value];
+    if (value >= 100) text.digits[text.length++] = '0' + value / 100;
+    if (value >= 10) text.digits[text.length++] = '0' + value / 10 % 10;
+    text.digits[text.length++] = '0' + value % 10;
+  }
+  return table;
+}();
 
 class IPv4 {
-  std::array<std::uint8_t, 4> data;
+  // Host order: a.b.c.d is a << 24 | b << 16 | c << 8 | d. Integer order is
+  // then address order, and ++ and -- carry across octets and wrap at
+  // 255.255.255.255 and 0.0.0.0 by plain unsigned arithmetic.
+  std::uint32_t bits;
 
  public:
-  IPv4() : data{0, 0, 0, 0} {}
+  constexpr IPv4() : bits(0) {}
 
-  IPv4(std::uint8_t a, std::uint8_t b, std::uint8_t c, std::uint8_t d)
-      : data{a, b, c, d} {}
+  constexpr IPv4(std::uint8_t a, std::uint8_t b, std::uint8_t c,
+                 std::uint8_t d)
+      : bits(std::uint32_t{a} << 24 | std::uint32_t{b} << 16 |
+             std::uint32_t{c} << 8 | d) {}
 
-  IPv4& operator++() {
-    for (int i = 3; i >= 0; --i) {
-      if (data[i] < 255) {
-        ++data[i];
-        return *this;
-      }
-      data[i] = 0;
-    }
+  // The address as a host-order number.
+  [[nodiscard]] constexpr std::uint32_t value() const { return bits; }
+
+  static constexpr IPv4 from_value(std::uint32_t value) {
+    IPv4 ip;
+    ip.bits = value;
+    return ip;
+  }
+
+  // Octet `i` counted from the left, so octet(0) of 10.1.2.3 is 10.
+  [[nodiscard]] constexpr std::uint8_t octet(int i) const {
+    return static_cast<std::uint8_t>(bits >> (24 - 8 * i));
+  }
+
+  // The four octets in network byte order, as they appear in packets and
+  // in sockaddr_in.
+  [[nodiscard]] constexpr std::array<std::uint8_t, 4> to_bytes() const {
+    return {octet(0), octet(1), octet(2), octet(3)};
+  }
+
+  static constexpr IPv4 from_bytes(const std::array<std::uint8_t, 4>& bytes) {
+    return IPv4(bytes[0], bytes[1], bytes[2], bytes[3]);
+  }
+
+  constexpr IPv4& operator++() {
+    ++bits;
     return *this;
   }
 
-  IPv4 operator++(int) {
+  constexpr IPv4 operator++(int) {
     IPv4 temp = *this;
-    ++(*this);
+    ++bits;
     return temp;
   }
 
-  IPv4& operator--() {
-    for (int i = 3; i >= 0; --i) {
-      if (data[i] > 0) {
-        --data[i];
-        return *this;
-      }
-      data[i] = 255;
-    }
+  constexpr IPv4& operator--() {
+    --bits;
     return *this;
   }
 
-  IPv4 operator--(int) {
+  constexpr IPv4 operator--(int) {
     IPv4 temp = *this;
-    --(*this);
+    --bits;
     return temp;
   }
 
-  friend bool operator==(const IPv4& left_ip, const IPv4& right_ip) {
-    return left_ip.data == right_ip.data;
+  friend constexpr bool operator==(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits == right_ip.bits;
   }
 
-  friend bool operator!=(const IPv4& left_ip, const IPv4& right_ip) {
-    return !(left_ip == right_ip);
+  friend constexpr bool operator!=(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits != right_ip.bits;
   }
 
-  friend bool operator<(const IPv4& left_ip, const IPv4& right_ip) {
-    return left_ip.data < right_ip.data;
+  friend constexpr bool operator<(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits < right_ip.bits;
   }
 
-  friend bool operator>(const IPv4& left_ip, const IPv4& right_ip) {
-    return right_ip < left_ip;
+  friend constexpr bool operator>(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits > right_ip.bits;
   }
 
-  friend bool operator<=(const IPv4& left_ip, const IPv4& right_ip) {
-    return !(left_ip > right_ip);
+  friend constexpr bool operator<=(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits <= right_ip.bits;
   }
 
-  friend bool operator>=(const IPv4& left_ip, const IPv4& right_ip) {
-    return !(left_ip < right_ip);
+  friend constexpr bool operator>=(const IPv4& left_ip, const IPv4& right_ip) {
+    return left_ip.bits >= right_ip.bits;
   }
 
   friend std::istream& operator>>(std::istream& is, IPv4& ip) {
@@ -77,8 +125,7 @@ class IPv4 {
     if (is >> a >> dot1 >> b >> dot2 >> c >> dot3 >> d) {
       if (dot1 == '.' && dot2 == '.' && dot3 == '.' && a >= 0 && a <= 255 &&
           b >= 0 && b <= 255 && c >= 0 && c <= 255 && d >= 0 && d <= 255) {
-        ip.data = {static_cast<uint8_t>(a), static_cast<uint8_t>(b),
-                   static_cast<uint8_t>(c), static_cast<uint8_t>(d)};
+        ip = IPv4(a, b, c, d);
       } else {
         is.setstate(std::ios::failbit);
       }
@@ -87,10 +134,605 @@ class IPv4 {
   }
 
   friend std::ostream& operator<<(std::ostream& os, const IPv4& ip) {
-    os << static_cast<int>(ip.data[0]) << '.' << static_cast<int>(ip.data[1])
-       << '.' << static_cast<int>(ip.data[2]) << '.'
-       << static_cast<int>(ip.data[3]);
-    return os;
+    char text[kMaxTextLength];
+    return os.write(text, to_chars(text, text + kMaxTextLength, ip).ptr - text);
+  }
+
+  // Longest dotted-quad text, "255.255.255.255".
+  static constexpr int kMaxTextLength = 15;
+
+  // Parses a dotted quad at the start of [first, last), like
+  // std::from_chars. Each part is one to three decimal digits. Anything
+  // accepted here is read the same way by operator>>, which also allows
+  // whitespace, signs and longer digit runs. On failure ptr is `first` and
+  // `ip` is unchanged.
+  friend std::from_chars_result from_chars(const char* first, const char* last,
+                                           IPv4& ip) {
+    std::array<std::uint8_t, 4> parts;
+    const char* p = first;
+    for (int i = 0; i < 4; ++i) {
+      if (i > 0) {
+        if (p == last || *p != '.') return {first, std::errc::invalid_argument};
+        ++p;
+      }
+      int value = 0;
+      const char* digits = p;
+      while (p != last && p - digits < 3 && *p >= '0' && *p <= '9') {
+        value = value * 10 + (*p++ - '0');
+      }
+      if (p == digits || (p != last && *p >= '0' && *p <= '9')) {
+        return {first, std::errc::invalid_argument};
+      }
+      if (value > 255) return {first, std::errc::result_out_of_range};
+      parts[i] = static_cast<std::uint8_t>(value);
+    }
+    ip = from_bytes(parts);
+    return {p, std::errc()};
+  }
+
+  // Writes the same text as operator<<, like std::to_chars.
+  friend std::to_chars_result to_chars(char* first, char* last,
+                                       const IPv4& ip) {
+    int length = 3;
+    for (int i = 0; i < 4; ++i) length += kOctetText[ip.octet(i)].length;
+    if (last - first < length) return {last, std::errc::value_too_large};
+    for (int i = 0; i < 4; ++i) {
+      if (i > 0) *first++ = '.';
+      const OctetText& text = kOctetText[ip.octet(i)];
+      // A fixed 3-byte copy while there is room for it; the last octet of
+      // an exactly sized buffer gets only its own digits.
+      if (last - first >= 3) {
+        std::memcpy(first, text.digits, 3);
+      } else {
+        std::memcpy(first, text.digits, text.length);
+      }
+      first += text.length;
+    }
+    return {first, std::errc()};
+  }
+};
+
+#ifdef __SSSE3__
+// Shuffles for the SSSE3 parser. A line is looked up by the mask of its
+// dots plus the bit of its terminating '\n'; each of the 81 valid layouts
+// moves the digits of part i right-aligned into bytes 4i..4i+2.
+struct DottedQuadLayouts {
+  std::vector<std::uint8_t> index = std::vector<std::uint8_t>(1 << 16, 0);
+  std::vector<std::array<std::uint8_t, 16>> shuffles;
+
+  DottedQuadLayouts() {
+    for (int layout = 0; layout < 81; ++layout) {
+      std::array<std::uint8_t, 16> shuffle;
+      shuffle.fill(0x80);
+      int start = 0, key = 0;
+      for (int i = 0, rest = layout; i < 4; ++i, rest /= 3) {
+        int length = rest % 3 + 1;
+        for (int k = 0; k < length; ++k) {
+          shuffle[4 * i + 3 - length + k] =
+              static_cast<std::uint8_t>(start + k);
+        }
+        start += length;
+        key |= 1 << start;
+        ++start;
+      }
+      shuffles.push_back(shuffle);
+      index[key] = static_cast<std::uint8_t>(shuffles.size());
+    }
+  }
+};
+
+// Parses the address at `p` when it is followed by '\n' within the 16
+// bytes that are read. Returns its length, or 0 to leave the line to the
+// scalar parser.
+inline std::size_t parse_line_ssse3(const char* p, IPv4& ip) {
+  static const DottedQuadLayouts layouts;
+  __m128i text = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i digits = _mm_sub_epi8(text, _mm_set1_epi8('0'));
+  __m128i is_digit =
+      _mm_cmpeq_epi8(_mm_min_epu8(digits, _mm_set1_epi8(9)), digits);
+  unsigned dots = _mm_movemask_epi8(_mm_cmpeq_epi8(text, _mm_set1_epi8('.')));
+  unsigned newlines =
+      _mm_movemask_epi8(_mm_cmpeq_epi8(text, _mm_set1_epi8('\n')));
+  unsigned body = static_cast<unsigned>(_mm_movemask_epi8(is_digit)) | dots;
+  unsigned length = __builtin_ctz(~body);
+  if (length > 15 || !(newlines >> length & 1)) return 0;
+  unsigned key = (dots & ((1u << length) - 1)) | 1u << length;
+  std::uint8_t layout = layouts.index[key];
+  if (layout == 0) return 0;
+  __m128i spread = _mm_shuffle_epi8(
+      digits, _mm_loadu_si128(reinterpret_cast<const __m128i*>(
+                  layouts.shuffles[layout - 1].data())));
+  __m128i tens = _mm_maddubs_epi16(
+      spread, _mm_setr_epi8(100, 10, 1, 0, 100, 10, 1, 0, 100, 10, 1, 0, 100,
+                            10, 1, 0));
+  __m128i parts = _mm_madd_epi16(tens, _mm_set1_epi16(1));
+  if (_mm_movemask_epi8(_mm_cmpgt_epi32(parts, _mm_set1_epi32(255)))) {
+    return 0;
+  }
+  // Gather the octets into the high-to-low bytes of the host-order value.
+  ip = IPv4::from_value(static_cast<std::uint32_t>(
+      _mm_cvtsi128_si32(_mm_shuffle_epi8(
+          parts, _mm_setr_epi8(12, 8, 4, 0, -1, -1, -1, -1, -1, -1, -1, -1,
+                               -1, -1, -1, -1)))));
+  return length;
+}
+#endif
+
+// Parses newline-separated addresses, one per line, from [begin, end) and
+// appends them to `out`. Lines that are not exactly one address are skipped
+// and counted; returns that count. The last line needs no '\n'.
+std::size_t parse_lines(const char* begin, const char* end,
+                        std::vector<IPv4>& out) {
+  std::size_t rejected = 0;
+  const char* p = begin;
+  while (p != end) {
+    IPv4 ip;
+#ifdef __SSSE3__
+    if (end - p >= 16) {
+      if (std::size_t length = parse_line_ssse3(p, ip)) {
+        out.push_back(ip);
+        p += length + 1;
+        continue;
+      }
+    }
+#endif
+    auto [next, error] = from_chars(p, end, ip);
+    if (error == std::errc() && (next == end || *next == '\n')) {
+      out.push_back(ip);
+    } else {
+      ++rejected;
+      next = static_cast<const char*>(std::memchr(p, '\n', end - p));
+      if (next == nullptr) next = end;
+    }
+    p = next == end ? end : next + 1;
+  }
+  return rejected;
+}
+
+// Appends each address and a '\n' to `out`.
+void format_lines(const IPv4* ips, std::size_t count, std::string& out) {
+  std::size_t size = out.size();
+  out.resize(size + count * (IPv4::kMaxTextLength + 1));
+  char* p = &out[size];
+  char* last = &out[0] + out.size();
+  for (std::size_t i = 0; i < count; ++i) {
+    p = to_chars(p, last, ips[i]).ptr;
+    *p++ = '\n';
+  }
+  out.resize(p - out.data());
+}
+
+// A network: an address with all but the first `length` bits cleared.
+class Cidr {
+  IPv4 network;
+  int length;
+
+ public:
+  Cidr() : length(0) {}
+
+  // Host bits of `address` are dropped, so 10.1.2.3/8 is 10.0.0.0/8.
+  // Throws std::invalid_argument for a prefix length outside [0, 32].
+  Cidr(IPv4 address, int prefix_length)
+      : network(IPv4::from_value(address.value() &
+                                 mask_of(checked_length(prefix_length)))),
+        length(prefix_length) {}
+
+  // `prefix_length` must be in [0, 32].
+  static std::uint32_t mask_of(int prefix_length) {
+    return prefix_length == 0 ? 0 : ~std::uint32_t{0} << (32 - prefix_length);
+  }
+
+  [[nodiscard]] IPv4 address() const { return network; }
+  [[nodiscard]] int prefix_length() const { return length; }
+  [[nodiscard]] std::uint32_t mask() const { return mask_of(length); }
+  [[nodiscard]] IPv4 first() const { return network; }
+  [[nodiscard]] IPv4 last() const {
+    return IPv4::from_value(network.value() | ~mask());
+  }
+
+  [[nodiscard]] bool contains(IPv4 ip) const {
+    return (ip.value() & mask()) == network.value();
+  }
+
+  friend bool operator==(const Cidr& left, const Cidr& right) {
+    return left.network == right.network && left.length == right.length;
+  }
+
+  friend bool operator!=(const Cidr& left, const Cidr& right) {
+    return !(left == right);
+  }
+
+  // Parses "a.b.c.d/n" with n from 0 to 32, as from_chars does for IPv4.
+  friend std::from_chars_result from_chars(const char* first, const char* last,
+                                           Cidr& cidr) {
+    IPv4 address;
+    auto [p, error] = from_chars(first, last, address);
+    if (error != std::errc()) return {first, error};
+    if (p == last || *p != '/') return {first, std::errc::invalid_argument};
+    int prefix_length = 0;
+    const char* digits = ++p;
+    while (p != last && p - digits < 2 && *p >= '0' && *p <= '9') {
+      prefix_length = prefix_length * 10 + (*p++ - '0');
+    }
+    if (p == digits || (p != last && *p >= '0' && *p <= '9')) {
+      return {first, std::errc::invalid_argument};
+    }
+    if (prefix_length > 32) return {first, std::errc::result_out_of_range};
+    cidr = Cidr(address, prefix_length);
+    return {p, std::errc()};
+  }
+
+  friend std::ostream& operator<<(std::ostream& os, const Cidr& cidr) {
+    return os << cidr.network << '/' << cidr.length;
+  }
+
+ private:
+  static int checked_length(int prefix_length) {
+    if (prefix_length < 0 || prefix_length > 32) {
+      throw std::invalid_argument("prefix length out of range");
+    }
+    return prefix_length;
+  }
+};
+
+// Longest-prefix match over a DIR-24-8 table: one 16-bit entry for each
+// /24, and for the /24s that hold longer prefixes a group of 256 entries,
+// one per address. A lookup is one or two dependent loads. Next hops are
+// small numbers, typically indexes into the caller's own table.
+class RoutingTable {
+ public:
+  struct Route {
+    Cidr prefix;
+    int next_hop;
+  };
+
+  static constexpr int kNoRoute = -1;
+  static constexpr int kMaxNextHop = 0x7ffe;
+  static constexpr std::size_t kMaxGroups = 0x8000;
+
+  RoutingTable() : by_24(std::size_t{1} << 24, 0) {}
+
+  // When several routes have the same prefix, the last one wins. Throws
+  // std::invalid_argument for a next hop outside [0, kMaxNextHop] and
+  // std::length_error when more than kMaxGroups /24s hold longer prefixes.
+  explicit RoutingTable(std::vector<Route> routes) : RoutingTable() {
+    // Shorter prefixes first, so that longer ones overwrite them.
+    std::stable_sort(routes.begin(), routes.end(),
+                     [](const Route& left, const Route& right) {
+                       return left.prefix.prefix_length() <
+                              right.prefix.prefix_length();
+                     });
+    for (const Route& route : routes) {
+      if (route.next_hop < 0 || route.next_hop > kMaxNextHop) {
+        throw std::invalid_argument("next hop out of range");
+      }
+      auto entry = static_cast<std::uint16_t>(route.next_hop + 1);
+      std::uint32_t first = route.prefix.first().value();
+      std::uint32_t last = route.prefix.last().value();
+      if (route.prefix.prefix_length() <= 24) {
+        std::fill(by_24.begin() + (first >> 8), by_24.begin() + (last >> 8) + 1,
+                  entry);
+        continue;
+      }
+      std::uint16_t& slot = by_24[first >> 8];
+      if (!(slot & kGroupBit)) {
+        if (groups.size() >> 8 == kMaxGroups) {
+          throw std::length_error("too many /24s with longer prefixes");
+        }
+        std::uint16_t group = static_cast<std::uint16_t>(groups.size() >> 8);
+        groups.resize(groups.size() + 256, slot);
+        slot = kGroupBit | group;
+      }
+      std::uint16_t* group = &groups[group_offset(slot)];
+      std::fill(group + (first & 0xff), group + (last & 0xff) + 1, entry);
+    }
+    groups.shrink_to_fit();
+  }
+
+  [[nodiscard]] int lookup(IPv4 ip) const {
+    std::uint32_t value = ip.value();
+    std::uint16_t entry = by_24[value >> 8];
+    if (entry & kGroupBit) {
+      entry = groups[group_offset(entry) | (value & 0xff)];
+    }
+    return entry - 1;
+  }
+
+  // Looks up `count` addresses into `next_hops`. The first-level loads of
+  // a block are all issued before any of them is used, so their cache
+  // misses overlap, and the entries a few blocks ahead are prefetched.
+  void lookup(const IPv4* ips, std::size_t count, int* next_hops) const {
+    constexpr std::size_t kBlock = 16;
+    constexpr std::size_t kAhead = 4 * kBlock;
+    std::uint16_t entries[kBlock];
+    for (std::size_t begin = 0; begin < count; begin += kBlock) {
+      std::size_t block = std::min(kBlock, count - begin);
+      for (std::size_t i = 0; i < block; ++i) {
+        entries[i] = by_24[ips[begin + i].value() >> 8];
+        if (begin + kAhead + i < count) {
+          __builtin_prefetch(&by_24[ips[begin + kAhead + i].value() >> 8]);
+        }
+      }
+      for (std::size_t i = 0; i < block; ++i) {
+        std::uint16_t entry = entries[i];
+        if (entry & kGroupBit) {
+          entry = groups[group_offset(entry) | (ips[begin + i].value() & 0xff)];
+        }
+        next_hops[begin + i] = entry - 1;
+      }
+    }
+  }
+
+  [[nodiscard]] std::size_t memory_bytes() const {
+    return (by_24.capacity() + groups.capacity()) * sizeof(std::uint16_t);
+  }
+
+ private:
+  static constexpr std::uint16_t kGroupBit = 0x8000;
+
+  static std::size_t group_offset(std::uint16_t entry) {
+    return static_cast<std::size_t>(entry & ~kGroupBit) << 8;
+  }
+
+  // An entry is 0 for no route, next hop + 1, or kGroupBit | group index.
+  std::vector<std::uint16_t> by_24;
+  std::vector<std::uint16_t> groups;
+};
+
+// A set of addresses kept as sorted, disjoint and non-adjacent closed
+// ranges, so its size depends on the number of runs, not of addresses.
+// Large sets also keep, for every /16, where its runs start, so that
+// contains() only searches the few runs of one /16.
+class IPv4Set {
+ public:
+  struct Range {
+    IPv4 first;
+    IPv4 last;
+
+    friend bool operator==(const Range& left, const Range& right) {
+      return left.first == right.first && left.last == right.last;
+    }
+  };
+
+  IPv4Set() = default;
+
+  // Ranges may come in any order, overlap or touch. A range with first >
+  // last is empty.
+  explicit IPv4Set(std::vector<Range> input) {
+    input.erase(std::remove_if(input.begin(), input.end(),
+                               [](const Range& range) {
+                                 return range.last < range.first;
+                               }),
+                input.end());
+    std::sort(input.begin(), input.end(),
+              [](const Range& left, const Range& right) {
+                return left.first < right.first;
+              });
+    for (const Range& range : input) {
+      append(range.first.value(), range.last.value());
+    }
+    build_index();
+  }
+
+  [[nodiscard]] bool empty() const { return runs.empty(); }
+
+  // Number of addresses; up to 2^32.
+  [[nodiscard]] std::uint64_t size() const {
+    std::uint64_t total = 0;
+    for (const Range& range : runs) {
+      total += std::uint64_t{range.last.value()} - range.first.value() + 1;
+    }
+    return total;
+  }
+
+  // The runs in ascending order.
+  [[nodiscard]] const std::vector<Range>& ranges() const { return runs; }
+
+  [[nodiscard]] bool contains(IPv4 ip) const {
+    std::uint32_t value = ip.value();
+    auto begin = runs.begin(), end = runs.end();
+    if (!index.empty()) {
+      begin = runs.begin() + index[value >> 16];
+      end = runs.begin() + index[(value >> 16) + 1];
+    }
+    // The last run starting at or before ip is the only one that can hold
+    // it.
+    auto after = std::upper_bound(begin, end, value,
+                                  [](std::uint32_t value, const Range& range) {
+                                    return value < range.first.value();
+                                  });
+    return after != runs.begin() && value <= (after - 1)->last.value();
+  }
+
+  // insert() and erase() find the runs they touch by binary search and
+  // splice them in place, so their cost is that of moving the later runs
+  // and /16 index entries. To build a large set, the constructor is still
+  // faster.
+  void insert(IPv4 first, IPv4 last) {
+    std::uint32_t low = first.value(), high = last.value();
+    if (high < low) return;
+    // The runs that overlap or touch [low, high] merge with it.
+    auto begin = std::lower_bound(
+        runs.begin(), runs.end(), low,
+        [](const Range& range, std::uint32_t low) {
+          return std::uint64_t{range.last.value()} + 1 < low;
+        });
+    auto end = std::upper_bound(
+        begin, runs.end(), high, [](std::uint32_t high, const Range& range) {
+          return std::uint64_t{high} + 1 < range.first.value();
+        });
+    Range merged{first, last};
+    if (begin != end) {
+      merged.first = std::min(first, begin->first);
+      merged.last = std::max(last, (end - 1)->last);
+    }
+    splice(begin - runs.begin(), end - runs.begin(), &merged, 1);
+  }
+  void insert(IPv4 ip) { insert(ip, ip); }
+  void insert(const Cidr& cidr) { insert(cidr.first(), cidr.last()); }
+
+  void erase(IPv4 first, IPv4 last) {
+    std::uint32_t low = first.value(), high = last.value();
+    if (high < low) return;
+    // The runs that overlap [low, high] lose that part; the first and last
+    // of them may keep a piece outside it.
+    auto begin = std::lower_bound(
+        runs.begin(), runs.end(), low,
+        [](const Range& range, std::uint32_t low) {
+          return range.last.value() < low;
+        });
+    auto end = std::upper_bound(
+        begin, runs.end(), high, [](std::uint32_t high, const Range& range) {
+          return high < range.first.value();
+        });
+    if (begin == end) return;
+    Range pieces[2];
+    std::size_t count = 0;
+    if (begin->first.value() < low) {
+      pieces[count++] = {begin->first, IPv4::from_value(low - 1)};
+    }
+    if ((end - 1)->last.value() > high) {
+      pieces[count++] = {IPv4::from_value(high + 1), (end - 1)->last};
+    }
+    splice(begin - runs.begin(), end - runs.begin(), pieces, count);
+  }
+  void erase(IPv4 ip) { erase(ip, ip); }
+  void erase(const Cidr& cidr) { erase(cidr.first(), cidr.last()); }
+
+  friend IPv4Set operator|(const IPv4Set& left, const IPv4Set& right) {
+    IPv4Set result;
+    result.runs.reserve(left.runs.size() + right.runs.size());
+    auto a = left.runs.begin(), b = right.runs.begin();
+    while (a != left.runs.end() || b != right.runs.end()) {
+      bool take_left = b == right.runs.end() ||
+                       (a != left.runs.end() && a->first < b->first);
+      const Range& range = take_left ? *a++ : *b++;
+      result.append(range.first.value(), range.last.value());
+    }
+    result.build_index();
+    return result;
+  }
+
+  friend IPv4Set operator&(const IPv4Set& left, const IPv4Set& right) {
+    IPv4Set result;
+    auto a = left.runs.begin(), b = right.runs.begin();
+    while (a != left.runs.end() && b != right.runs.end()) {
+      std::uint32_t first = std::max(a->first.value(), b->first.value());
+      std::uint32_t last = std::min(a->last.value(), b->last.value());
+      if (first <= last) result.append(first, last);
+      // Drop the run that ends first; the other may overlap the next one.
+      if (a->last < b->last) {
+        ++a;
+      } else {
+        ++b;
+      }
+    }
+    result.build_index();
+    return result;
+  }
+
+  friend IPv4Set operator-(const IPv4Set& left, const IPv4Set& right) {
+    IPv4Set result;
+    auto b = right.runs.begin();
+    for (const Range& range : left.runs) {
+      std::uint64_t first = range.first.value();
+      std::uint64_t last = range.last.value();
+      while (b != right.runs.end() && b->last.value() < first) ++b;
+      for (auto cut = b; cut != right.runs.end() && cut->first.value() <= last;
+           ++cut) {
+        if (cut->first.value() > first) {
+          result.append(static_cast<std::uint32_t>(first),
+                        cut->first.value() - 1);
+        }
+        first = std::uint64_t{cut->last.value()} + 1;
+      }
+      if (first <= last) {
+        result.append(static_cast<std::uint32_t>(first),
+                      static_cast<std::uint32_t>(last));
+      }
+    }
+    result.build_index();
+    return result;
+  }
+
+  friend bool operator==(const IPv4Set& left, const IPv4Set& right) {
+    return left.runs == right.runs;
+  }
+
+  friend bool operator!=(const IPv4Set& left, const IPv4Set& right) {
+    return !(left == right);
+  }
+
+ private:
+  static constexpr std::size_t kIndexedRuns = 4096;
+
+  std::vector<Range> runs;
+  // When there are more than kIndexedRuns runs, index[h] is the number of
+  // runs that start before h << 16.
+  std::vector<std::uint32_t> index;
+
+  void build_index() {
+    index.clear();
+    if (runs.size() <= kIndexedRuns) return;
+    index.resize((1 << 16) + 1);
+    std::size_t run = 0;
+    for (std::uint32_t high = 0; high < 1 << 16; ++high) {
+      while (run < runs.size() && runs[run].first.value() >> 16 < high) ++run;
+      index[high] = static_cast<std::uint32_t>(run);
+    }
+    index[1 << 16] = static_cast<std::uint32_t>(runs.size());
+  }
+
+  // Replaces runs[begin, end) with pieces[0, count), which must keep the
+  // runs sorted and apart, and updates the index to match.
+  void splice(std::size_t begin, std::size_t end, const Range* pieces,
+              std::size_t count) {
+    // The lowest and highest start that is removed or added.
+    std::uint32_t low = UINT32_MAX, high = 0;
+    for (std::size_t i = begin; i < end; ++i) {
+      low = std::min(low, runs[i].first.value());
+      high = std::max(high, runs[i].first.value());
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      low = std::min(low, pieces[i].first.value());
+      high = std::max(high, pieces[i].first.value());
+    }
+    std::size_t removed = end - begin;
+    if (count < removed) {
+      runs.erase(runs.begin() + begin + count, runs.begin() + end);
+    } else if (count > removed) {
+      runs.insert(runs.begin() + end, count - removed, Range());
+    }
+    std::copy(pieces, pieces + count, runs.begin() + begin);
+
+    if (runs.size() <= kIndexedRuns || index.empty()) {
+      build_index();
+      return;
+    }
+    // index[h] counts the runs that start before h << 16: it cannot change
+    // up to the bucket of `low`, may change up to that of `high`, and moves
+    // by the change in size after it.
+    std::size_t run = index[low >> 16];
+    for (std::uint32_t h = (low >> 16) + 1; h <= high >> 16; ++h) {
+      while (run < runs.size() && runs[run].first.value() >> 16 < h) ++run;
+      index[h] = static_cast<std::uint32_t>(run);
+    }
+    auto grown = static_cast<std::uint32_t>(count - removed);
+    for (std::uint32_t h = (high >> 16) + 1; h <= 1 << 16; ++h) {
+      index[h] += grown;
+    }
+  }
+
+  // Adds [first, last], which starts no earlier than the last run.
+  void append(std::uint32_t first, std::uint32_t last) {
+    if (!runs.empty() &&
+        first <= std::uint64_t{runs.back().last.value()} + 1) {
+      if (runs.back().last.value() < last) {
+        runs.back().last = IPv4::from_value(last);
+      }
+      return;
+    }
+    runs.push_back({IPv4::from_value(first), IPv4::from_value(last)});
   }
 };
 
@@ -123,7 +765,593 @@ void test() {
   assert(IPv4(192, 168, 1, 1) == IPv4(192, 168, 1, 1));
 }
 
-int main() {
+// The byte-array layout IPv4 had before it became a single uint32_t, kept
+// for the layout benchmark and to check that the semantics did not change.
+struct LegacyIPv4 {
+  std::array<std::uint8_t, 4> data;
+
+  LegacyIPv4& operator++() {
+    for (int i = 3; i >= 0; --i) {
+      if (data[i] < 255) {
+        ++data[i];
+        return *this;
+      }
+      data[i] = 0;
+    }
+    return *this;
+  }
+
+  LegacyIPv4& operator--() {
+    for (int i = 3; i >= 0; --i) {
+      if (data[i] > 0) {
+        --data[i];
+        return *this;
+      }
+      data[i] = 255;
+    }
+    return *this;
+  }
+
+  friend bool operator<(const LegacyIPv4& left, const LegacyIPv4& right) {
+    return left.data < right.data;
+  }
+};
+
+void test_layout() {
+  static_assert(sizeof(IPv4) == 4);
+  static_assert(IPv4(1, 2, 3, 4).value() == 0x01020304);
+  static_assert(++IPv4(255, 255, 255, 255) == IPv4());
+  static_assert(--IPv4() == IPv4(255, 255, 255, 255));
+  static_assert(++IPv4(10, 0, 255, 255) == IPv4(10, 1, 0, 0));
+  static_assert(IPv4(9, 255, 255, 255) < IPv4(10, 0, 0, 0));
+  static_assert(IPv4(1, 2, 3, 4).to_bytes()[0] == 1);
+  static_assert(IPv4::from_bytes({1, 2, 3, 4}) == IPv4(1, 2, 3, 4));
+  static_assert(IPv4(192, 168, 1, 2).octet(1) == 168);
+
+  std::mt19937 gen(6);
+  for (int round = 0; round < 100000; ++round) {
+    std::uint32_t bits = gen();
+    // Bias towards octets of 0 and 255, where the carries happen.
+    for (int shift = 0; shift < 32; shift += 8) {
+      if (gen() % 3 == 0) bits |= 0xffu << shift;
+      if (gen() % 3 == 0) bits &= ~(0xffu << shift);
+    }
+    IPv4 ip = IPv4::from_value(bits), other = IPv4::from_value(gen());
+    LegacyIPv4 legacy{ip.to_bytes()}, legacy_other{other.to_bytes()};
+    assert((ip < other) == (legacy < legacy_other));
+    IPv4 next = ip, previous = ip;
+    ++next;
+    --previous;
+    assert(next.to_bytes() == (++LegacyIPv4(legacy)).data);
+    assert(previous.to_bytes() == (--LegacyIPv4(legacy)).data);
+  }
+}
+
+void test_cidr() {
+  Cidr net(IPv4(10, 1, 2, 3), 8);
+  assert(net.address() == IPv4(10, 0, 0, 0) && net.prefix_length() == 8);
+  assert(net.last() == IPv4(10, 255, 255, 255));
+  assert(net.contains(IPv4(10, 200, 0, 1)) && !net.contains(IPv4(11, 0, 0, 0)));
+  assert(Cidr(IPv4(1, 2, 3, 4), 0).contains(IPv4(255, 255, 255, 255)));
+  assert(Cidr(IPv4(1, 2, 3, 4), 32).last() == IPv4(1, 2, 3, 4));
+  for (int bad_length : {-1, 33, 64}) {
+    try {
+      Cidr(IPv4(1, 2, 3, 4), bad_length);
+      assert(false);
+    } catch (const std::invalid_argument&) {
+    }
+  }
+  IPv4 ip(192, 168, 1, 2);
+  assert(ip.value() == 0xc0a80102 && IPv4::from_value(ip.value()) == ip);
+
+  std::string text = "192.168.7.1/20";
+  Cidr parsed;
+  auto [ptr, error] =
+      from_chars(text.data(), text.data() + text.size(), parsed);
+  assert(error == std::errc() && ptr == text.data() + text.size());
+  assert(parsed == Cidr(IPv4(192, 168, 0, 0), 20));
+  std::stringstream stream;
+  stream << parsed;
+  assert(stream.str() == "192.168.0.0/20");
+  for (const std::string bad : {"1.2.3.4", "1.2.3.4/", "1.2.3.4/33",
+                                "1.2.3.4/100", "1.2.3.4/-1", "1.2.3/8"}) {
+    auto result = from_chars(bad.data(), bad.data() + bad.size(), parsed);
+    assert(result.ec != std::errc() || result.ptr != bad.data() + bad.size());
+  }
+}
+
+void test_routing_table() {
+  RoutingTable empty;
+  assert(empty.lookup(IPv4(1, 2, 3, 4)) == RoutingTable::kNoRoute);
+
+  RoutingTable table({{Cidr(IPv4(10, 0, 0, 0), 8), 1},
+                      {Cidr(IPv4(10, 1, 2, 128), 25), 3},
+                      {Cidr(IPv4(10, 1, 0, 0), 16), 2},
+                      {Cidr(IPv4(10, 1, 2, 200), 32), 4},
+                      {Cidr(IPv4(), 0), 0},
+                      {Cidr(IPv4(10, 1, 0, 0), 16), 5}});
+  assert(table.lookup(IPv4(11, 0, 0, 1)) == 0);
+  assert(table.lookup(IPv4(10, 9, 9, 9)) == 1);
+  assert(table.lookup(IPv4(10, 1, 2, 127)) == 5);
+  assert(table.lookup(IPv4(10, 1, 2, 128)) == 3);
+  assert(table.lookup(IPv4(10, 1, 2, 200)) == 4);
+  assert(table.lookup(IPv4(10, 1, 2, 255)) == 3);
+
+  // Random tables against a linear scan for the longest match.
+  std::mt19937 gen(3);
+  for (int round = 0; round < 4; ++round) {
+    std::vector<RoutingTable::Route> routes;
+    for (int i = 0; i < 300; ++i) {
+      // Few distinct high bits, so that prefixes nest.
+      std::uint32_t bits = (gen() & 0x0303ffff) | 0x0a000000;
+      routes.push_back({Cidr(IPv4::from_value(bits), 4 + gen() % 29),
+                        static_cast<int>(gen() % 1000)});
+    }
+    RoutingTable lpm(routes);
+    std::vector<IPv4> ips;
+    std::vector<int> expected;
+    for (int i = 0; i < 20000; ++i) {
+      IPv4 ip = IPv4::from_value(i % 2 ? gen()
+                                       : (gen() & 0x0303ffff) | 0x0a000000);
+      int best_length = -1, best_hop = RoutingTable::kNoRoute;
+      for (const auto& route : routes) {
+        if (route.prefix.contains(ip) &&
+            route.prefix.prefix_length() >= best_length) {
+          best_length = route.prefix.prefix_length();
+          best_hop = route.next_hop;
+        }
+      }
+      assert(lpm.lookup(ip) == best_hop);
+      ips.push_back(ip);
+      expected.push_back(best_hop);
+    }
+    std::vector<int> hops(ips.size());
+    lpm.lookup(ips.data(), ips.size(), hops.data());
+    assert(hops == expected);
+  }
+
+  bool threw = false;
+  try {
+    RoutingTable bad({{Cidr(IPv4(), 0), RoutingTable::kMaxNextHop + 1}});
+  } catch (const std::invalid_argument&) {
+    threw = true;
+  }
+  assert(threw);
+}
+
+void test_ipv4_set() {
+  IPv4Set set({{IPv4(10, 0, 0, 5), IPv4(10, 0, 0, 9)},
+               {IPv4(10, 0, 0, 0), IPv4(10, 0, 0, 4)},
+               {IPv4(10, 0, 1, 0), IPv4(10, 0, 0, 255)},
+               {IPv4(192, 168, 0, 0), IPv4(192, 168, 0, 0)}});
+  assert(set.ranges().size() == 2 && set.size() == 11);
+  assert(set.ranges()[0].first == IPv4(10, 0, 0, 0));
+  assert(set.ranges()[0].last == IPv4(10, 0, 0, 9));
+  assert(set.contains(IPv4(10, 0, 0, 7)) && set.contains(IPv4(192, 168, 0, 0)));
+  assert(!set.contains(IPv4(10, 0, 0, 10)) && !set.contains(IPv4()));
+
+  IPv4Set all({{IPv4(), IPv4(255, 255, 255, 255)}});
+  assert(all.size() == std::uint64_t{1} << 32);
+  all.erase(Cidr(IPv4(128, 0, 0, 0), 1));
+  all.erase(IPv4());
+  assert(all.ranges().size() == 1);
+  assert(all.size() == (std::uint64_t{1} << 31) - 1);
+  all.insert(IPv4(255, 255, 255, 255));
+  all.insert(IPv4());
+  assert(all.ranges().size() == 2 && all.contains(IPv4(255, 255, 255, 255)));
+
+  // Enough runs for the /16 index: run i is [i << 18, (i << 18) + i % 7].
+  std::vector<IPv4Set::Range> many;
+  for (std::uint32_t i = 0; i < 16384; ++i) {
+    many.push_back({IPv4::from_value(i << 18),
+                    IPv4::from_value((i << 18) + i % 7)});
+  }
+  IPv4Set indexed(many);
+  assert(indexed.ranges().size() == 16384);
+  for (std::uint32_t i = 0; i < 16384; i += 3) {
+    for (std::uint32_t offset : {0u, 1u, 6u, 7u, 65535u, 65536u, 262143u}) {
+      std::uint32_t value = (i << 18) + offset;
+      assert(indexed.contains(IPv4::from_value(value)) == (offset <= i % 7));
+    }
+  }
+  assert(!(indexed - indexed).contains(IPv4()));
+  assert((indexed & indexed).contains(IPv4::from_value((5 << 18) + 5)));
+
+  // Small random sets against std::vector<bool> over 0.0.0.0-0.0.3.255.
+  std::mt19937 gen(5);
+  const std::uint32_t kUniverse = 1024;
+  auto random_set = [&](std::vector<bool>& bits) {
+    std::vector<IPv4Set::Range> ranges;
+    for (int k = gen() % 12; k > 0; --k) {
+      std::uint32_t first = gen() % kUniverse;
+      std::uint32_t length = gen() % 100;
+      std::uint32_t last = std::min(kUniverse - 1, first + length);
+      ranges.push_back({IPv4::from_value(first), IPv4::from_value(last)});
+      for (std::uint32_t v = first; v <= last; ++v) bits[v] = true;
+    }
+    return IPv4Set(ranges);
+  };
+  auto check = [&](const IPv4Set& set, const std::vector<bool>& bits) {
+    std::uint64_t count = 0;
+    for (std::uint32_t v = 0; v < kUniverse; ++v) {
+      assert(set.contains(IPv4::from_value(v)) == bits[v]);
+      count += bits[v];
+    }
+    assert(set.size() == count);
+    for (std::size_t i = 1; i < set.ranges().size(); ++i) {
+      assert(set.ranges()[i - 1].last.value() + 1 <
+             set.ranges()[i].first.value());
+    }
+  };
+  for (int round = 0; round < 500; ++round) {
+    std::vector<bool> a(kUniverse), b(kUniverse), expected(kUniverse);
+    IPv4Set left = random_set(a), right = random_set(b);
+    check(left, a);
+    for (std::uint32_t v = 0; v < kUniverse; ++v) expected[v] = a[v] || b[v];
+    check(left | right, expected);
+    for (std::uint32_t v = 0; v < kUniverse; ++v) expected[v] = a[v] && b[v];
+    check(left & right, expected);
+    for (std::uint32_t v = 0; v < kUniverse; ++v) expected[v] = a[v] && !b[v];
+    check(left - right, expected);
+    assert(((left - right) | (left & right)) == left);
+
+    // insert() and erase() in place against the bits.
+    std::vector<bool> bits = a;
+    for (int step = 0; step < 20; ++step) {
+      std::uint32_t first = gen() % kUniverse;
+      std::uint32_t length = gen() % 100;
+      std::uint32_t last = std::min(kUniverse - 1, first + length);
+      bool add = gen() % 2;
+      if (add) {
+        left.insert(IPv4::from_value(first), IPv4::from_value(last));
+      } else {
+        left.erase(IPv4::from_value(first), IPv4::from_value(last));
+      }
+      for (std::uint32_t v = first; v <= last; ++v) bits[v] = add;
+    }
+    check(left, bits);
+  }
+
+  // In place on an indexed set, against the same edits made with | and -,
+  // with ranges that cross /16 boundaries and often merge or split runs.
+  IPv4Set edited = indexed, rebuilt = indexed;
+  for (int step = 0; step < 3000; ++step) {
+    std::uint32_t first = static_cast<std::uint32_t>(gen()) >> 2;
+    std::uint32_t last = first + gen() % (step % 100 == 0 ? 1 << 26 : 1 << 19);
+    IPv4Set::Range range{IPv4::from_value(first), IPv4::from_value(last)};
+    if (gen() % 2) {
+      edited.insert(range.first, range.last);
+      rebuilt = rebuilt | IPv4Set({range});
+    } else {
+      edited.erase(range.first, range.last);
+      rebuilt = rebuilt - IPv4Set({range});
+    }
+    if (step % 100 == 0) {
+      assert(edited == rebuilt);
+      for (int probe = 0; probe < 2000; ++probe) {
+        IPv4 ip = IPv4::from_value(static_cast<std::uint32_t>(gen()));
+        assert(edited.contains(ip) == rebuilt.contains(ip));
+      }
+      for (const IPv4Set::Range& run : rebuilt.ranges()) {
+        assert(edited.contains(run.first) && edited.contains(run.last));
+      }
+    }
+  }
+  assert(edited == rebuilt && edited.ranges().size() > 4096);
+}
+
+void test_from_chars() {
+  auto parse = [](const std::string& text, IPv4& ip) {
+    auto [ptr, error] = from_chars(text.data(), text.data() + text.size(), ip);
+    return error == std::errc() && ptr == text.data() + text.size();
+  };
+  IPv4 ip;
+  assert(parse("0.0.0.0", ip) && ip == IPv4());
+  assert(parse("255.255.255.255", ip) && ip == IPv4(255, 255, 255, 255));
+  assert(parse("10.020.3.004", ip) && ip == IPv4(10, 20, 3, 4));
+  for (const std::string bad :
+       {"", "1.2.3", "1.2.3.", ".1.2.3", "1..2.3", "256.0.0.0", "1.2.3.256",
+        "1.2.3.1000", "0001.2.3.4", "+1.2.3.4", "-1.2.3.4", " 1.2.3.4",
+        "1 .2.3.4", "1.2.3.4x", "1,2.3.4", "a.b.c.d"}) {
+    IPv4 unchanged(9, 9, 9, 9);
+    auto [ptr, error] =
+        from_chars(bad.data(), bad.data() + bad.size(), unchanged);
+    if (error == std::errc()) {
+      assert(ptr != bad.data() + bad.size());
+    } else {
+      assert(ptr == bad.data() && unchanged == IPv4(9, 9, 9, 9));
+    }
+  }
+  std::string text = "1.2.3.4:80";
+  auto [ptr, error] = from_chars(text.data(), text.data() + text.size(), ip);
+  assert(error == std::errc() && *ptr == ':' && ip == IPv4(1, 2, 3, 4));
+  assert(from_chars(text.data(), text.data() + 5, ip).ec ==
+         std::errc::invalid_argument);
+  assert(from_chars("300.1.1.1", text.data() + 9, ip).ec ==
+         std::errc::result_out_of_range);
+
+  // Everything from_chars accepts, operator>> reads the same way.
+  for (int value = 0; value < 256; ++value) {
+    IPv4 original(value, 255 - value, value / 2, value % 10);
+    char buffer[IPv4::kMaxTextLength];
+    auto written = to_chars(buffer, buffer + sizeof(buffer), original);
+    assert(written.ec == std::errc());
+    std::string printed(buffer, written.ptr);
+    std::stringstream stream;
+    stream << original;
+    assert(stream.str() == printed);
+    IPv4 streamed, parsed;
+    stream >> streamed;
+    assert(parse(printed, parsed) && parsed == original);
+    assert(streamed == original);
+  }
+  char small[6];
+  assert(to_chars(small, small + sizeof(small), IPv4(1, 2, 3, 4)).ec ==
+         std::errc::value_too_large);
+  // Exactly sized heap buffers, so that a sanitizer sees any write past
+  // the end.
+  for (IPv4 exact : {IPv4(1, 2, 3, 4), IPv4(10, 2, 30, 4), IPv4(1, 20, 3, 45),
+                     IPv4(255, 255, 255, 255)}) {
+    std::stringstream stream;
+    stream << exact;
+    std::size_t length = stream.str().size();
+    auto buffer = std::make_unique<char[]>(length);
+    auto written = to_chars(buffer.get(), buffer.get() + length, exact);
+    assert(written.ec == std::errc() && written.ptr == buffer.get() + length);
+    assert(std::string(buffer.get(), length) == stream.str());
+  }
+}
+
+void test_bulk() {
+  std::string text =
+      "1.2.3.4\n255.255.255.255\nbad\n\n10.0.0.256\n"
+      "192.168.001.010\n1.2.3.4.5\n7.7.7.7\r\n0.0.0.0";
+  std::vector<IPv4> ips;
+  assert(parse_lines(text.data(), text.data() + text.size(), ips) == 5);
+  assert(ips == std::vector<IPv4>({IPv4(1, 2, 3, 4),
+                                   IPv4(255, 255, 255, 255),
+                                   IPv4(192, 168, 1, 10), IPv4()}));
+  std::string formatted;
+  format_lines(ips.data(), ips.size(), formatted);
+  assert(formatted == "1.2.3.4\n255.255.255.255\n192.168.1.10\n0.0.0.0\n");
+
+  // Random lines, valid and not: the bulk parser must agree with parsing
+  // every line through from_chars.
+  std::mt19937 gen(7);
+  const std::string alphabet = "0123456789...\n";
+  for (int round = 0; round < 2000; ++round) {
+    std::string lines;
+    int count = gen() % 20;
+    for (int line = 0; line < count; ++line) {
+      if (gen() % 2) {
+        IPv4 ip(gen() % 256, gen() % 256, gen() % 256, gen() % 256);
+        char buffer[IPv4::kMaxTextLength];
+        lines.append(buffer, to_chars(buffer, buffer + 15, ip).ptr);
+      } else {
+        for (int k = gen() % 18; k > 0; --k) {
+          lines += alphabet[gen() % alphabet.size()];
+        }
+      }
+      lines += '\n';
+    }
+    std::vector<IPv4> expected;
+    std::size_t expected_rejected = 0;
+    std::stringstream stream(lines);
+    for (std::string line; std::getline(stream, line);) {
+      IPv4 ip;
+      auto [ptr, error] =
+          from_chars(line.data(), line.data() + line.size(), ip);
+      if (error == std::errc() && ptr == line.data() + line.size()) {
+        expected.push_back(ip);
+      } else {
+        ++expected_rejected;
+      }
+    }
+    std::vector<IPv4> parsed;
+    assert(parse_lines(lines.data(), lines.data() + lines.size(), parsed) ==
+           expected_rejected);
+    assert(parsed == expected);
+  }
+}
+
+template <typename Function>
+double nanoseconds(Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+void benchmark_layout() {
+  const std::size_t kCount = 4000000;
+  std::mt19937 gen(8);
+  std::vector<IPv4> ips;
+  std::vector<LegacyIPv4> legacy;
+  for (std::size_t i = 0; i < kCount; ++i) {
+    ips.push_back(IPv4::from_value(gen()));
+    legacy.push_back({ips.back().to_bytes()});
+  }
+
+  std::size_t ordered = 0, legacy_ordered = 0;
+  double compare_ns = nanoseconds([&] {
+    for (std::size_t i = 1; i < kCount; ++i) ordered += ips[i - 1] < ips[i];
+  });
+  double legacy_compare_ns = nanoseconds([&] {
+    for (std::size_t i = 1; i < kCount; ++i) {
+      legacy_ordered += legacy[i - 1] < legacy[i];
+    }
+  });
+  assert(ordered == legacy_ordered);
+
+  double increment_ns = nanoseconds([&] {
+    for (IPv4& ip : ips) ++ip;
+  });
+  double legacy_increment_ns = nanoseconds([&] {
+    for (LegacyIPv4& ip : legacy) ++ip;
+  });
+
+  double sort_ns = nanoseconds([&] { std::sort(ips.begin(), ips.end()); });
+  double legacy_sort_ns =
+      nanoseconds([&] { std::sort(legacy.begin(), legacy.end()); });
+  for (std::size_t i = 0; i < kCount; i += 997) {
+    assert(ips[i].to_bytes() == legacy[i].data);
+  }
+
+  auto report = [](const char* name, double ns, double legacy_ns) {
+    std::cout << name << ": uint32_t " << ns / kCount << " ns, byte array "
+              << legacy_ns / kCount << " ns (x" << legacy_ns / ns << ")\n";
+  };
+  report("compare", compare_ns, legacy_compare_ns);
+  report("increment", increment_ns, legacy_increment_ns);
+  report("sort", sort_ns, legacy_sort_ns);
+}
+
+void benchmark_routing() {
+  const std::size_t kRoutes = 1000000;
+  const std::size_t kLookups = 10000000;
+  std::mt19937 gen(2);
+  std::vector<RoutingTable::Route> routes;
+  for (std::size_t i = 0; i < kRoutes; ++i) {
+    // Roughly the shape of a full BGP table: mostly /24 and /16-/23, with
+    // a few longer prefixes.
+    std::uint32_t pick = gen() % 100;
+    int length = pick < 55 ? 24 : pick < 99 ? 16 + gen() % 8 : 25 + gen() % 8;
+    routes.push_back({Cidr(IPv4::from_value(gen()), length),
+                      static_cast<int>(gen() % 1000)});
+  }
+  RoutingTable table;
+  double build_ns = nanoseconds([&] { table = RoutingTable(routes); });
+  std::vector<IPv4> ips;
+  for (std::size_t i = 0; i < kLookups; ++i) {
+    ips.push_back(IPv4::from_value(gen()));
+  }
+  std::vector<int> hops(kLookups);
+  double single_ns = nanoseconds([&] {
+    for (std::size_t i = 0; i < kLookups; ++i) hops[i] = table.lookup(ips[i]);
+  });
+  std::vector<int> batched(kLookups);
+  double batch_ns = nanoseconds(
+      [&] { table.lookup(ips.data(), ips.size(), batched.data()); });
+  assert(hops == batched);
+  std::cout << kRoutes << " routes: build " << build_ns * 1e-6 << " ms, "
+            << table.memory_bytes() / (1 << 20) << " MiB\n"
+            << "lookup " << single_ns / kLookups << " ns ("
+            << kLookups / (single_ns * 1e-9) / 1e6 << " M/s), batched "
+            << batch_ns / kLookups << " ns ("
+            << kLookups / (batch_ns * 1e-9) / 1e6 << " M/s)\n";
+}
+
+void benchmark_sets() {
+  const std::size_t kRanges = 1000000;
+  const std::size_t kLookups = 10000000;
+  std::mt19937 gen(4);
+  auto random_ranges = [&] {
+    std::vector<IPv4Set::Range> ranges;
+    for (std::size_t i = 0; i < kRanges; ++i) {
+      std::uint32_t first = gen();
+      std::uint32_t last = first + std::min<std::uint32_t>(
+                                       ~first, gen() % 4096);
+      ranges.push_back({IPv4::from_value(first), IPv4::from_value(last)});
+    }
+    return ranges;
+  };
+  std::vector<IPv4Set::Range> left_ranges = random_ranges();
+  std::vector<IPv4Set::Range> right_ranges = random_ranges();
+  IPv4Set left, right, both;
+  double build_ns = nanoseconds([&] { left = IPv4Set(left_ranges); });
+  right = IPv4Set(right_ranges);
+  double union_ns = nanoseconds([&] { both = left | right; });
+  double intersection_ns = nanoseconds([&] { both = left & right; });
+  double difference_ns = nanoseconds([&] { both = left - right; });
+  const std::size_t kEdits = 1000;
+  both = left;
+  double edit_ns = nanoseconds([&] {
+    for (std::size_t i = 0; i < kEdits; ++i) {
+      IPv4 first = IPv4::from_value(gen() & ~0xfffu);
+      IPv4 last = IPv4::from_value(first.value() | 0xfff);
+      if (i % 2) {
+        both.insert(first, last);
+      } else {
+        both.erase(first, last);
+      }
+    }
+  });
+  std::vector<IPv4> ips;
+  for (std::size_t i = 0; i < kLookups; ++i) {
+    ips.push_back(IPv4::from_value(gen()));
+  }
+  std::size_t hits = 0;
+  double contains_ns = nanoseconds([&] {
+    for (const IPv4& ip : ips) hits += left.contains(ip);
+  });
+  std::cout << kRanges << " ranges (" << left.size() << " addresses, "
+            << left.ranges().size() * sizeof(IPv4Set::Range) / (1 << 20)
+            << " MiB): build " << build_ns * 1e-6 << " ms, union "
+            << union_ns * 1e-6 << " ms, intersection "
+            << intersection_ns * 1e-6 << " ms, difference "
+            << difference_ns * 1e-6 << " ms\ninsert or erase "
+            << edit_ns / kEdits * 1e-3 << " us, contains "
+            << contains_ns / kLookups << " ns (" << hits << " hits)\n";
+}
+
+void benchmark_text() {
+  const std::size_t kCount = 2000000;
+  std::mt19937 gen(1);
+  std::vector<IPv4> ips;
+  for (std::size_t i = 0; i < kCount; ++i) {
+    std::uint32_t bits = gen();
+    ips.emplace_back(bits >> 24, bits >> 16 & 0xff, bits >> 8 & 0xff,
+                     bits & 0xff);
+  }
+  std::string text;
+  double format_ns = nanoseconds([&] {
+    format_lines(ips.data(), ips.size(), text);
+  });
+  std::ostringstream out;
+  double stream_format_ns = nanoseconds([&] {
+    for (const IPv4& ip : ips) out << ip << '\n';
+  });
+  assert(out.str() == text);
+
+  std::vector<IPv4> parsed;
+  parsed.reserve(kCount);
+  double parse_ns = nanoseconds([&] {
+    parse_lines(text.data(), text.data() + text.size(), parsed);
+  });
+  std::vector<IPv4> streamed;
+  std::istringstream in(text);
+  double stream_parse_ns = nanoseconds([&] {
+    for (IPv4 ip; in >> ip;) streamed.push_back(ip);
+  });
+  assert(parsed == ips && streamed == ips);
+
+  std::cout << "format: operator<< " << stream_format_ns / kCount
+            << " ns/address, format_lines " << format_ns / kCount
+            << " ns/address\n"
+            << "parse: operator>> " << stream_parse_ns / kCount
+            << " ns/address, parse_lines " << parse_ns / kCount
+            << " ns/address"
+#ifdef __SSSE3__
+            << " (SSSE3)"
+#endif
+            << "\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    benchmark_layout();
+    benchmark_text();
+    benchmark_routing();
+    benchmark_sets();
+    return 0;
+  }
   test();
+  test_layout();
+  test_cidr();
+  test_routing_table();
+  test_ipv4_set();
+  test_from_chars();
+  test_bulk();
   return 0;
 }
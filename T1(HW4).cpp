@@ -1,20 +1,117 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cctype>
 #include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <initializer_list>
 #include <iostream>
+#include <map>
 #include <memory>
+#include <new>
 #include <sstream>
-#include <stack>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 
+// The JIT backend needs x86-64 and mmap(); elsewhere run(JitExpression)
+// interprets.
+#if defined(__x86_64__) && \
+    (defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__))
+#define RPN_NATIVE_JIT 1
+#include <sys/mman.h>
+#else
+#define RPN_NATIVE_JIT 0
+#endif
+
+// Building with -DRPN_COUNT_ALLOCATIONS replaces the global operator new
+// with one that counts heap allocations, so that the tests and benchmark can
+// show that evaluation does not allocate. It is off by default: the count is
+// an atomic update on every allocation of every thread.
+#ifdef RPN_COUNT_ALLOCATIONS
+constexpr bool kCountsAllocations = true;
+std::atomic<std::size_t> allocation_count{0};
+
+[[gnu::noinline]] void* operator new(std::size_t size) {
+  allocation_count.fetch_add(1, std::memory_order_relaxed);
+  if (void* memory = std::malloc(size == 0 ? 1 : size)) {
+    return memory;
+  }
+  throw std::bad_alloc();
+}
+
+[[gnu::noinline]] void operator delete(void* memory) noexcept {
+  std::free(memory);
+}
+
+[[gnu::noinline]] void operator delete(void* memory,
+                                       std::size_t /*size*/) noexcept {
+  std::free(memory);
+}
+#else
+constexpr bool kCountsAllocations = false;
+#endif
+
+// Heap allocations so far, or 0 when they are not counted.
+std::size_t allocationCount() {
+#ifdef RPN_COUNT_ALLOCATIONS
+  return allocation_count.load(std::memory_order_relaxed);
+#else
+  return 0;
+#endif
+}
+
 struct Operation {
+  // Largest arity the default executeBlock() can gather.
+  static constexpr int kMaxArity = 8;
+
   virtual ~Operation() = default;
   [[nodiscard]] virtual int getArity() const = 0;
-  [[nodiscard]] virtual double execute(
-      const std::vector<double>& args) const = 0;
+  // Reads getArity() operands, in push order, straight from the stack.
+  [[nodiscard]] virtual double execute(const double* args) const = 0;
+
+  // Applies the operation to `count` elements at once. Operand k of element
+  // i is operands[k * stride + i]; the result replaces operand 0.
+  virtual void executeBlock(double* operands, std::size_t stride,
+                            std::size_t count) const {
+    int arity = getArity();
+    assert(arity <= kMaxArity);
+    double args[kMaxArity];
+    for (std::size_t i = 0; i < count; ++i) {
+      for (int k = 0; k < arity; ++k) {
+        args[k] = operands[k * stride + i];
+      }
+      operands[i] = execute(args);
+    }
+  }
 };
 
+template <typename Function>
+void applyUnary(double* operands, std::size_t count, Function function) {
+  for (std::size_t i = 0; i < count; ++i) {
+    operands[i] = function(operands[i]);
+  }
+}
+
+template <typename Function>
+void applyBinary(double* operands, std::size_t stride, std::size_t count,
+                 Function function) {
+  const double* right = operands + stride;
+  for (std::size_t i = 0; i < count; ++i) {
+    operands[i] = function(operands[i], right[i]);
+  }
+}
+
 struct UnaryOperation : Operation {
   [[nodiscard]] int getArity() const override { return 1; }
 };
@@ -28,88 +125,169 @@ struct TernaryOperation : Operation {
 };
 
 struct SinOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::sin(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    applyUnary(operands, count, [](double x) { return std::sin(x); });
+  }
 };
 
 struct CosOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::cos(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    applyUnary(operands, count, [](double x) { return std::cos(x); });
+  }
 };
 
 struct TgOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::tan(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    applyUnary(operands, count, [](double x) { return std::tan(x); });
+  }
 };
 
 struct CtgOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return 1.0 / std::tan(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    applyUnary(operands, count,
+               [](double x) { return 1.0 / std::tan(x); });
+  }
 };
 
 struct ExpOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::exp(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    applyUnary(operands, count, [](double x) { return std::exp(x); });
+  }
 };
 
 struct LogOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     if (args[0] <= 0) throw std::runtime_error("log domain error");
     return std::log(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    if (std::any_of(operands, operands + count,
+                    [](double x) { return x <= 0; }))
+      throw std::runtime_error("log domain error");
+    applyUnary(operands, count, [](double x) { return std::log(x); });
+  }
 };
 
 struct SqrtOp : UnaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     if (args[0] < 0) throw std::runtime_error("sqrt domain error");
     return std::sqrt(args[0]);
   }
+
+  void executeBlock(double* operands, std::size_t /*stride*/,
+                    std::size_t count) const override {
+    if (std::any_of(operands, operands + count, [](double x) { return x < 0; }))
+      throw std::runtime_error("sqrt domain error");
+    applyUnary(operands, count, [](double x) { return std::sqrt(x); });
+  }
 };
 
 struct AddOp : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return args[0] + args[1];
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return a + b; });
+  }
 };
 
 struct SubOp : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return args[0] - args[1];
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return a - b; });
+  }
 };
 
 struct MulOp : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return args[0] * args[1];
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return a * b; });
+  }
 };
 
 struct DivOp : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     if (args[1] == 0) throw std::runtime_error("division by zero");
     return args[0] / args[1];
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    const double* divisors = operands + stride;
+    if (std::any_of(divisors, divisors + count,
+                    [](double x) { return x == 0; }))
+      throw std::runtime_error("division by zero");
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return a / b; });
+  }
 };
 
 struct Atan2Op : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::atan2(args[0], args[1]);
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return std::atan2(a, b); });
+  }
 };
 
 struct PowOp : BinaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     return std::pow(args[0], args[1]);
   }
+
+  void executeBlock(double* operands, std::size_t stride,
+                    std::size_t count) const override {
+    applyBinary(operands, stride, count,
+                [](double a, double b) { return std::pow(a, b); });
+  }
 };
 
 struct MedianOp : TernaryOperation {
-  [[nodiscard]] double execute(const std::vector<double>& args) const override {
+  [[nodiscard]] double execute(const double* args) const override {
     double a = args[0], b = args[1], c = args[2];
     if ((a <= b && b <= c) || (c <= b && b <= a)) return b;
     if ((b <= a && a <= c) || (c <= a && a <= b)) return a;
@@ -117,9 +295,460 @@ struct MedianOp : TernaryOperation {
   }
 };
 
+// One step of a compiled expression: push `value`, push the variable with
+// index `variable`, or apply `operation` to the top `arity` values of the
+// stack.
+struct Instruction {
+  const Operation* operation = nullptr;
+  int arity = 0;
+  int variable = -1;
+  double value = 0;
+};
+
+// An expression tokenised, resolved and checked once, ready to be run many
+// times. `max_depth` is the largest stack it needs.
+struct CompiledExpression {
+  std::vector<Instruction> code;
+  std::size_t max_depth = 0;
+  std::size_t variable_count = 0;
+};
+
+// Number of elements runBatch() pushes through each instruction at once; a
+// multiple of every SIMD width.
+constexpr std::size_t kBatchBlock = 256;
+
+// One step of an optimised expression. Values live in numbered slots; each
+// step reads its `args` slots and fills `out` (and `second_out` for kSinCos).
+struct OptimizedStep {
+  enum class Kind { kApply, kAdd, kSub, kMul, kMulAdd, kSinCos };
+
+  Kind kind = Kind::kApply;
+  const Operation* operation = nullptr;
+  int arity = 0;
+  std::array<int, Operation::kMaxArity> args{};
+  int out = 0;
+  int second_out = -1;
+};
+
+// An expression after optimize(): constants are already in `slots`,
+// variables are copied into their slots by `loads`, and the remaining
+// operations run as `steps` in the order evaluate() would first reach them.
+struct OptimizedExpression {
+  std::vector<double> slots;
+  std::vector<std::pair<int, int>> loads;
+  std::vector<OptimizedStep> steps;
+  int result = 0;
+  std::size_t variable_count = 0;
+};
+
+// Rewrites a compiled expression as a DAG and simplifies it:
+//  * subtrees of constants are folded through Operation::execute, unless
+//    they throw, in which case they are kept to throw at run time;
+//  * equal subexpressions are computed once;
+//  * a product used only by a sum becomes one multiply-add step, and sin and
+//    cos of the same value become one step.
+// Steps keep the order in which evaluate() first computes each value, so the
+// first domain error raised is the same. Empty code throws "no result".
+OptimizedExpression optimize(const CompiledExpression& compiled) {
+  if (compiled.code.empty()) {
+    throw std::runtime_error("no result");
+  }
+  struct Node {
+    const Operation* operation = nullptr;
+    int variable = -1;
+    double value = 0;
+    int arity = 0;
+    std::array<int, Operation::kMaxArity> args{};
+  };
+  using Key = std::tuple<const Operation*, int, std::uint64_t,
+                         std::array<int, Operation::kMaxArity>>;
+  std::vector<Node> nodes;
+  std::map<Key, int> known;
+  auto intern = [&](const Node& node) {
+    std::uint64_t bits;
+    std::memcpy(&bits, &node.value, sizeof(bits));
+    auto [it, inserted] = known.try_emplace(
+        Key{node.operation, node.variable, bits, node.args},
+        static_cast<int>(nodes.size()));
+    if (inserted) {
+      nodes.push_back(node);
+    }
+    return it->second;
+  };
+  auto is_constant = [&](int id) {
+    return nodes[id].operation == nullptr && nodes[id].variable < 0;
+  };
+
+  std::vector<int> stack;
+  for (const Instruction& instruction : compiled.code) {
+    Node node;
+    node.operation = instruction.operation;
+    node.variable = instruction.variable;
+    node.value = instruction.value;
+    if (instruction.operation != nullptr) {
+      if (instruction.arity > Operation::kMaxArity) {
+        throw std::invalid_argument("operation arity too large to optimize");
+      }
+      node.arity = instruction.arity;
+      std::copy(stack.end() - node.arity, stack.end(), node.args.begin());
+      stack.resize(stack.size() - node.arity);
+      if (std::all_of(node.args.begin(), node.args.begin() + node.arity,
+                      is_constant)) {
+        double values[Operation::kMaxArity];
+        for (int k = 0; k < node.arity; ++k) {
+          values[k] = nodes[node.args[k]].value;
+        }
+        try {
+          double folded = node.operation->execute(values);
+          node = Node{};
+          node.value = folded;
+        } catch (const std::runtime_error&) {
+        }
+      }
+    }
+    stack.push_back(intern(node));
+  }
+
+  std::vector<int> uses(nodes.size(), 0);
+  std::vector<char> live(nodes.size(), 0);
+  live[stack.back()] = 1;
+  for (int id = static_cast<int>(nodes.size()) - 1; id >= 0; --id) {
+    if (!live[id]) continue;
+    for (int k = 0; k < nodes[id].arity; ++k) {
+      live[nodes[id].args[k]] = 1;
+      ++uses[nodes[id].args[k]];
+    }
+  }
+
+  // Pair up sin and cos of the same value, and sums with a product that
+  // nothing else uses.
+  std::vector<int> sin_of(nodes.size(), -1);
+  std::vector<int> cos_of(nodes.size(), -1);
+  std::vector<int> product_of(nodes.size(), -1);
+  std::vector<char> skipped(nodes.size(), 0);
+  for (int id = 0; id < static_cast<int>(nodes.size()); ++id) {
+    const Node& node = nodes[id];
+    if (!live[id]) continue;
+    if (dynamic_cast<const SinOp*>(node.operation)) {
+      sin_of[node.args[0]] = id;
+    } else if (dynamic_cast<const CosOp*>(node.operation)) {
+      cos_of[node.args[0]] = id;
+    } else if (dynamic_cast<const AddOp*>(node.operation)) {
+      for (int k = 0; k < 2; ++k) {
+        int product = node.args[k];
+        if (dynamic_cast<const MulOp*>(nodes[product].operation) &&
+            uses[product] == 1) {
+          product_of[id] = k;
+          skipped[product] = 1;
+          break;
+        }
+      }
+    }
+  }
+
+  OptimizedExpression optimized;
+  optimized.variable_count = compiled.variable_count;
+  optimized.slots.resize(nodes.size());
+  optimized.result = stack.back();
+  for (int id = 0; id < static_cast<int>(nodes.size()); ++id) {
+    const Node& node = nodes[id];
+    if (!live[id] || skipped[id]) continue;
+    if (node.operation == nullptr) {
+      if (node.variable < 0) {
+        optimized.slots[id] = node.value;
+      } else {
+        optimized.loads.emplace_back(id, node.variable);
+      }
+      continue;
+    }
+    OptimizedStep step;
+    step.operation = node.operation;
+    step.arity = node.arity;
+    step.args = node.args;
+    step.out = id;
+    int sin = node.arity == 1 ? sin_of[node.args[0]] : -1;
+    int cos = node.arity == 1 ? cos_of[node.args[0]] : -1;
+    if (sin >= 0 && cos >= 0 && (sin == id || cos == id)) {
+      step.kind = OptimizedStep::Kind::kSinCos;
+      step.out = sin;
+      step.second_out = cos;
+      skipped[sin == id ? cos : sin] = 1;
+    } else if (product_of[id] < 0 && step.arity == 2) {
+      // The plain arithmetic that cannot fail is run without a virtual call.
+      if (dynamic_cast<const AddOp*>(node.operation)) {
+        step.kind = OptimizedStep::Kind::kAdd;
+      } else if (dynamic_cast<const SubOp*>(node.operation)) {
+        step.kind = OptimizedStep::Kind::kSub;
+      } else if (dynamic_cast<const MulOp*>(node.operation)) {
+        step.kind = OptimizedStep::Kind::kMul;
+      }
+    }
+    if (product_of[id] >= 0) {
+      const Node& product = nodes[node.args[product_of[id]]];
+      step.kind = OptimizedStep::Kind::kMulAdd;
+      step.arity = 3;
+      step.args = {product.args[0], product.args[1],
+                   node.args[1 - product_of[id]]};
+    }
+    optimized.steps.push_back(step);
+  }
+  return optimized;
+}
+
+// Native x86-64 code for one compiled expression. The generated function
+// keeps the same stack layout as run(): every stack position has a fixed
+// offset, arithmetic and sqrt are inline SSE2, and the other operations
+// call small C++ helpers. Domain checks run in the same order as in run(),
+// and a failure returns one of the JitError codes instead of throwing, since
+// exceptions cannot unwind through generated code. When native code is not
+// available, RPNCalculator::run() falls back to the interpreter.
+class JitExpression {
+ public:
+  enum JitError { kOk = 0, kDivisionByZero, kLogDomain, kSqrtDomain };
+  using Function = int (*)(const double* variables, double* stack);
+
+  JitExpression() = default;
+  explicit JitExpression(CompiledExpression compiled)
+      : compiled_(std::move(compiled)) {
+#if RPN_NATIVE_JIT
+    // Empty code has no result to return; the interpreter reports that.
+    std::vector<unsigned char> code;
+    if (compiled_.code.empty() || !emit(code)) return;
+    void* memory = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) return;
+    std::memcpy(memory, code.data(), code.size());
+    if (mprotect(memory, code.size(), PROT_READ | PROT_EXEC) != 0) {
+      munmap(memory, code.size());
+      return;
+    }
+    memory_ = memory;
+    size_ = code.size();
+#endif
+  }
+
+  JitExpression(const JitExpression&) = delete;
+  JitExpression& operator=(const JitExpression&) = delete;
+  JitExpression(JitExpression&& other) noexcept { *this = std::move(other); }
+  JitExpression& operator=(JitExpression&& other) noexcept {
+    if (this != &other) {
+      release();
+      compiled_ = std::move(other.compiled_);
+      memory_ = std::exchange(other.memory_, nullptr);
+      size_ = std::exchange(other.size_, 0);
+    }
+    return *this;
+  }
+  ~JitExpression() { release(); }
+
+  // False when the expression runs through the interpreter instead.
+  [[nodiscard]] bool native() const { return memory_ != nullptr; }
+  [[nodiscard]] Function function() const {
+    return reinterpret_cast<Function>(memory_);
+  }
+  [[nodiscard]] const CompiledExpression& compiled() const {
+    return compiled_;
+  }
+
+  static const char* message(int error) {
+    switch (error) {
+      case kDivisionByZero:
+        return "division by zero";
+      case kLogDomain:
+        return "log domain error";
+      case kSqrtDomain:
+        return "sqrt domain error";
+      default:
+        return "unknown error";
+    }
+  }
+
+ private:
+  CompiledExpression compiled_;
+  void* memory_ = nullptr;
+  std::size_t size_ = 0;
+
+  void release() {
+#if RPN_NATIVE_JIT
+    if (memory_ != nullptr) munmap(memory_, size_);
+#endif
+    memory_ = nullptr;
+    size_ = 0;
+  }
+
+#if RPN_NATIVE_JIT
+  using Unary = double (*)(double);
+  using Binary = double (*)(double, double);
+
+  // Call targets for the operations that are not emitted inline. They must
+  // give exactly what the matching Operation::execute() gives.
+  static Unary unaryHelper(const Operation* operation) {
+    if (dynamic_cast<const SinOp*>(operation)) {
+      return [](double x) { return std::sin(x); };
+    }
+    if (dynamic_cast<const CosOp*>(operation)) {
+      return [](double x) { return std::cos(x); };
+    }
+    if (dynamic_cast<const TgOp*>(operation)) {
+      return [](double x) { return std::tan(x); };
+    }
+    if (dynamic_cast<const CtgOp*>(operation)) {
+      return [](double x) { return 1.0 / std::tan(x); };
+    }
+    if (dynamic_cast<const ExpOp*>(operation)) {
+      return [](double x) { return std::exp(x); };
+    }
+    if (dynamic_cast<const LogOp*>(operation)) {
+      return [](double x) { return std::log(x); };
+    }
+    return nullptr;
+  }
+
+  static Binary binaryHelper(const Operation* operation) {
+    if (dynamic_cast<const Atan2Op*>(operation)) {
+      return [](double a, double b) { return std::atan2(a, b); };
+    }
+    if (dynamic_cast<const PowOp*>(operation)) {
+      return [](double a, double b) { return std::pow(a, b); };
+    }
+    return nullptr;
+  }
+
+  static double median(const double* args) {
+    return MedianOp().execute(args);
+  }
+
+  // Emits the function for compiled_; false if it uses an operation that
+  // has no native form. Registers: rbx is the stack, r12 the variables.
+  bool emit(std::vector<unsigned char>& code) const {
+    auto bytes = [&](std::initializer_list<unsigned char> list) {
+      code.insert(code.end(), list);
+    };
+    auto imm32 = [&](std::uint32_t value) {
+      for (int k = 0; k < 4; ++k) code.push_back(value >> (8 * k) & 0xff);
+    };
+    auto imm64 = [&](std::uint64_t value) {
+      for (int k = 0; k < 8; ++k) code.push_back(value >> (8 * k) & 0xff);
+    };
+    auto offset = [](std::size_t depth) {
+      return static_cast<std::uint32_t>(depth * sizeof(double));
+    };
+    // movsd xmm<reg>, [rbx + offset] (load) or the store form.
+    auto movsd = [&](unsigned char opcode, int reg, std::size_t depth) {
+      bytes({0xf2, 0x0f, opcode, static_cast<unsigned char>(0x83 | reg << 3)});
+      imm32(offset(depth));
+    };
+    auto load = [&](int reg, std::size_t depth) { movsd(0x10, reg, depth); };
+    auto store = [&](std::size_t depth) { movsd(0x11, 0, depth); };
+    auto call = [&](const void* target) {
+      bytes({0x48, 0xb8});  // mov rax, target
+      imm64(reinterpret_cast<std::uintptr_t>(target));
+      bytes({0xff, 0xd0});  // call rax
+    };
+    // Jumps to the epilogue with `error` in eax; 10 bytes long.
+    std::vector<std::size_t> exits;
+    auto fail = [&](JitError error) {
+      code.push_back(0xb8);  // mov eax, error
+      imm32(error);
+      code.push_back(0xe9);  // jmp epilogue
+      exits.push_back(code.size());
+      imm32(0);
+    };
+
+    bytes({0x53, 0x41, 0x54});        // push rbx; push r12
+    bytes({0x48, 0x83, 0xec, 0x08});  // sub rsp, 8 (keeps calls aligned)
+    bytes({0x48, 0x89, 0xf3});        // mov rbx, rsi
+    bytes({0x49, 0x89, 0xfc});        // mov r12, rdi
+
+    std::size_t depth = 0;
+    for (const Instruction& instruction : compiled_.code) {
+      const Operation* operation = instruction.operation;
+      if (operation == nullptr) {
+        if (instruction.variable < 0) {
+          std::uint64_t bits;
+          std::memcpy(&bits, &instruction.value, sizeof(bits));
+          bytes({0x48, 0xb8});  // mov rax, value
+          imm64(bits);
+        } else {
+          bytes({0x49, 0x8b, 0x84, 0x24});  // mov rax, [r12 + variable]
+          imm32(offset(instruction.variable));
+        }
+        bytes({0x48, 0x89, 0x83});  // mov [rbx + depth], rax
+        imm32(offset(depth));
+        ++depth;
+        continue;
+      }
+      depth -= instruction.arity;
+      std::size_t a = depth, b = depth + 1;
+      if (dynamic_cast<const AddOp*>(operation) ||
+          dynamic_cast<const SubOp*>(operation) ||
+          dynamic_cast<const MulOp*>(operation)) {
+        unsigned char opcode = dynamic_cast<const AddOp*>(operation)   ? 0x58
+                               : dynamic_cast<const SubOp*>(operation) ? 0x5c
+                                                                       : 0x59;
+        load(0, a);
+        movsd(opcode, 0, b);  // addsd/subsd/mulsd xmm0, [rbx + b]
+      } else if (dynamic_cast<const DivOp*>(operation)) {
+        load(1, b);
+        bytes({0x66, 0x0f, 0x57, 0xd2});  // xorpd xmm2, xmm2
+        bytes({0x66, 0x0f, 0x2e, 0xca});  // ucomisd xmm1, xmm2
+        bytes({0x7a, 12, 0x75, 10});      // jp ok; jne ok (NaN is not zero)
+        fail(kDivisionByZero);
+        load(0, a);
+        bytes({0xf2, 0x0f, 0x5e, 0xc1});  // divsd xmm0, xmm1
+      } else if (dynamic_cast<const SqrtOp*>(operation)) {
+        load(0, a);
+        bytes({0x66, 0x0f, 0x57, 0xd2});  // xorpd xmm2, xmm2
+        bytes({0x66, 0x0f, 0x2e, 0xc2});  // ucomisd xmm0, xmm2
+        bytes({0x73, 12, 0x7a, 10});      // jae ok; jp ok
+        fail(kSqrtDomain);
+        bytes({0xf2, 0x0f, 0x51, 0xc0});  // sqrtsd xmm0, xmm0
+      } else if (dynamic_cast<const MedianOp*>(operation)) {
+        bytes({0x48, 0x8d, 0xbb});  // lea rdi, [rbx + a]
+        imm32(offset(a));
+        call(reinterpret_cast<const void*>(&median));
+      } else if (Unary helper = unaryHelper(operation)) {
+        load(0, a);
+        if (dynamic_cast<const LogOp*>(operation)) {
+          bytes({0x66, 0x0f, 0x57, 0xd2});  // xorpd xmm2, xmm2
+          bytes({0x66, 0x0f, 0x2e, 0xc2});  // ucomisd xmm0, xmm2
+          bytes({0x7a, 12, 0x77, 10});      // jp ok; ja ok
+          fail(kLogDomain);
+        }
+        call(reinterpret_cast<const void*>(helper));
+      } else if (Binary helper = binaryHelper(operation)) {
+        load(0, a);
+        load(1, b);
+        call(reinterpret_cast<const void*>(helper));
+      } else {
+        return false;
+      }
+      store(a);
+      ++depth;
+    }
+
+    bytes({0x31, 0xc0});  // xor eax, eax
+    std::size_t epilogue = code.size();
+    bytes({0x48, 0x83, 0xc4, 0x08});  // add rsp, 8
+    bytes({0x41, 0x5c, 0x5b, 0xc3});  // pop r12; pop rbx; ret
+    for (std::size_t exit : exits) {
+      auto rel = static_cast<std::uint32_t>(epilogue - (exit + 4));
+      for (int k = 0; k < 4; ++k) code[exit + k] = rel >> (8 * k) & 0xff;
+    }
+    return true;
+  }
+#endif
+};
+
 class RPNCalculator {
   std::unordered_map<std::string, std::unique_ptr<Operation>> operations_;
-  std::stack<double> stack_;
+  // Scratch buffers, reused so that evaluation does not allocate once they
+  // have grown to fit the expressions seen.
+  std::vector<double> stack_;
+  std::string token_;
+  std::vector<double> run_stack_;
+  std::vector<double> batch_stack_;
+  std::vector<double> slots_;
 
   void initOperations() {
     operations_["+"] = std::make_unique<AddOp>();
@@ -142,50 +771,254 @@ class RPNCalculator {
   RPNCalculator() { initOperations(); }
 
   double evaluate(const std::string& expression) {
-    std::istringstream iss(expression);
-    std::string token;
+    stack_.clear();
+    std::size_t position = 0;
 
-    while (iss >> token) {
-      auto it = operations_.find(token);
+    while (nextToken(expression, position, token_)) {
+      auto it = operations_.find(token_);
       if (it != operations_.end()) {
         const Operation* op = it->second.get();
-        int arity = op->getArity();
-        if (stack_.size() < static_cast<size_t>(arity)) {
+        std::size_t arity = op->getArity();
+        if (stack_.size() < arity) {
           throw std::runtime_error("not enough operands");
         }
-        std::vector<double> args(arity);
-        for (int i = arity - 1; i >= 0; --i) {
-          args[i] = stack_.top();
-          stack_.pop();
-        }
+        double* args = stack_.data() + stack_.size() - arity;
         try {
-          double result = op->execute(args);
-          stack_.push(result);
+          args[0] = op->execute(args);
         } catch (const std::runtime_error& e) {
           throw std::runtime_error(std::string("operation error: ") + e.what());
         }
+        stack_.resize(stack_.size() - arity + 1);
       } else {
         try {
-          double value = std::stod(token);
-          stack_.push(value);
+          double value = std::stod(token_);
+          stack_.push_back(value);
         } catch (const std::invalid_argument&) {
-          throw std::runtime_error("invalid token: " + token);
+          throw std::runtime_error("invalid token: " + token_);
         } catch (const std::out_of_range&) {
-          throw std::runtime_error("number out of range: " + token);
+          throw std::runtime_error("number out of range: " + token_);
         }
       }
     }
 
     if (stack_.size() == 1) {
-      double result = stack_.top();
-      stack_.pop();
-      return result;
+      return stack_.back();
     }
     if (stack_.size() > 1) {
       throw std::runtime_error("too many operands");
     }
     throw std::runtime_error("no result");
   }
+
+  // Copies the whitespace-separated token starting at or after `position`
+  // into `token` and moves `position` past it; false once none is left.
+  static bool nextToken(const std::string& expression, std::size_t& position,
+                        std::string& token) {
+    auto is_space = [](char c) {
+      return std::isspace(static_cast<unsigned char>(c)) != 0;
+    };
+    while (position < expression.size() && is_space(expression[position])) {
+      ++position;
+    }
+    std::size_t begin = position;
+    while (position < expression.size() && !is_space(expression[position])) {
+      ++position;
+    }
+    token.assign(expression, begin, position - begin);
+    return position > begin;
+  }
+
+  // Parses the expression and reports the same token and operand-count
+  // errors as evaluate(). Domain errors can only surface in run(). Tokens
+  // listed in `variables` are read from the values passed to run().
+  [[nodiscard]] CompiledExpression compile(
+      const std::string& expression,
+      const std::vector<std::string>& variables = {}) const {
+    std::string token;
+    std::size_t position = 0;
+    CompiledExpression compiled;
+    compiled.variable_count = variables.size();
+    std::size_t depth = 0;
+
+    while (nextToken(expression, position, token)) {
+      Instruction instruction;
+      auto it = operations_.find(token);
+      auto variable = std::find(variables.begin(), variables.end(), token);
+      if (it != operations_.end()) {
+        instruction.operation = it->second.get();
+        instruction.arity = instruction.operation->getArity();
+        if (depth < static_cast<size_t>(instruction.arity)) {
+          throw std::runtime_error("not enough operands");
+        }
+        depth = depth - instruction.arity + 1;
+      } else if (variable != variables.end()) {
+        instruction.variable =
+            static_cast<int>(variable - variables.begin());
+        ++depth;
+      } else {
+        try {
+          instruction.value = std::stod(token);
+        } catch (const std::invalid_argument&) {
+          throw std::runtime_error("invalid token: " + token);
+        } catch (const std::out_of_range&) {
+          throw std::runtime_error("number out of range: " + token);
+        }
+        ++depth;
+      }
+      compiled.max_depth = std::max(compiled.max_depth, depth);
+      compiled.code.push_back(instruction);
+    }
+
+    if (depth > 1) {
+      throw std::runtime_error("too many operands");
+    }
+    if (depth == 0) {
+      throw std::runtime_error("no result");
+    }
+    return compiled;
+  }
+
+  // `variables` holds one value per name given to compile(). Code that
+  // compile() did not produce, such as a default-constructed or moved-from
+  // expression, may be empty and then has no result.
+  double run(const CompiledExpression& compiled,
+             const double* variables = nullptr) {
+    if (compiled.code.empty()) {
+      throw std::runtime_error("no result");
+    }
+    if (run_stack_.size() < compiled.max_depth) {
+      run_stack_.resize(compiled.max_depth);
+    }
+    double* top = run_stack_.data();
+    for (const Instruction& instruction : compiled.code) {
+      if (instruction.operation == nullptr) {
+        *top++ = instruction.variable < 0 ? instruction.value
+                                          : variables[instruction.variable];
+        continue;
+      }
+      top -= instruction.arity;
+      try {
+        *top = instruction.operation->execute(top);
+        ++top;
+      } catch (const std::runtime_error& e) {
+        throw std::runtime_error(std::string("operation error: ") + e.what());
+      }
+    }
+    return run_stack_[0];
+  }
+
+  double run(const OptimizedExpression& optimized,
+             const double* variables = nullptr) {
+    // Every optimized expression has at least its result slot.
+    if (optimized.slots.empty()) {
+      throw std::runtime_error("no result");
+    }
+    slots_.assign(optimized.slots.begin(), optimized.slots.end());
+    double* slots = slots_.data();
+    for (const auto& [slot, variable] : optimized.loads) {
+      slots[slot] = variables[variable];
+    }
+    for (const OptimizedStep& step : optimized.steps) {
+      const int* args = step.args.data();
+      switch (step.kind) {
+        case OptimizedStep::Kind::kAdd:
+          slots[step.out] = slots[args[0]] + slots[args[1]];
+          break;
+        case OptimizedStep::Kind::kSub:
+          slots[step.out] = slots[args[0]] - slots[args[1]];
+          break;
+        case OptimizedStep::Kind::kMul:
+          slots[step.out] = slots[args[0]] * slots[args[1]];
+          break;
+        case OptimizedStep::Kind::kMulAdd: {
+          // The product goes through a volatile so that it is rounded on its
+          // own, like MulOp; -ffp-contract would otherwise fuse the two
+          // operations into one FMA when the target has it.
+          volatile double product = slots[args[0]] * slots[args[1]];
+          slots[step.out] = product + slots[args[2]];
+          break;
+        }
+        case OptimizedStep::Kind::kSinCos: {
+          double value = slots[args[0]];
+          slots[step.out] = std::sin(value);
+          slots[step.second_out] = std::cos(value);
+          break;
+        }
+        case OptimizedStep::Kind::kApply: {
+          double values[Operation::kMaxArity];
+          for (int k = 0; k < step.arity; ++k) {
+            values[k] = slots[args[k]];
+          }
+          try {
+            slots[step.out] = step.operation->execute(values);
+          } catch (const std::runtime_error& e) {
+            throw std::runtime_error(std::string("operation error: ") +
+                                     e.what());
+          }
+          break;
+        }
+      }
+    }
+    return slots[optimized.result];
+  }
+
+  // Runs the native code when there is any, the interpreter otherwise.
+  double run(const JitExpression& jit, const double* variables = nullptr) {
+    if (!jit.native()) return run(jit.compiled(), variables);
+    if (run_stack_.size() < jit.compiled().max_depth) {
+      run_stack_.resize(jit.compiled().max_depth);
+    }
+    if (int error = jit.function()(variables, run_stack_.data())) {
+      throw std::runtime_error(std::string("operation error: ") +
+                               JitExpression::message(error));
+    }
+    return run_stack_[0];
+  }
+
+  // Evaluates the expression for `count` sets of variables: element i uses
+  // columns[v][i] for variable v and its result goes to out[i]. Elements go
+  // through the instructions kBatchBlock at a time, each stack slot holding
+  // a block, so every operation runs its executeBlock() kernel. If any
+  // element fails, throws the error of the first instruction that fails on
+  // the first failing block, which is not necessarily that of the first
+  // failing element; `out` is then unspecified.
+  void runBatch(const CompiledExpression& compiled,
+                const std::vector<const double*>& columns, std::size_t count,
+                double* out) {
+    if (columns.size() < compiled.variable_count) {
+      throw std::invalid_argument("missing variable columns");
+    }
+    if (compiled.code.empty()) {
+      throw std::runtime_error("no result");
+    }
+    if (batch_stack_.size() < compiled.max_depth * kBatchBlock) {
+      batch_stack_.resize(compiled.max_depth * kBatchBlock);
+    }
+    for (std::size_t first = 0; first < count; first += kBatchBlock) {
+      std::size_t block = std::min(kBatchBlock, count - first);
+      double* top = batch_stack_.data();
+      for (const Instruction& instruction : compiled.code) {
+        if (instruction.operation == nullptr) {
+          if (instruction.variable < 0) {
+            std::fill(top, top + block, instruction.value);
+          } else {
+            const double* column = columns[instruction.variable] + first;
+            std::copy(column, column + block, top);
+          }
+          top += kBatchBlock;
+          continue;
+        }
+        top -= instruction.arity * kBatchBlock;
+        try {
+          instruction.operation->executeBlock(top, kBatchBlock, block);
+        } catch (const std::runtime_error& e) {
+          throw std::runtime_error(std::string("operation error: ") + e.what());
+        }
+        top += kBatchBlock;
+      }
+      std::copy(batch_stack_.data(), batch_stack_.data() + block, out + first);
+    }
+  }
 };
 
 void test() {
@@ -202,7 +1035,613 @@ void test() {
   }
 }
 
-int main() {
+// Consecutive result lines, or consecutive error lines, of a batch.
+struct BatchOutput {
+  bool error = false;
+  std::string text;
+};
+
+constexpr std::size_t kBatchChunkBytes = std::size_t{16} << 20;
+
+// Evaluates the lines of [begin, end) the way test() does and appends what
+// test() would print to `output`.
+void evaluateLines(const char* begin, const char* end, RPNCalculator& calc,
+                   std::vector<BatchOutput>& output) {
+  std::string line;
+  char number[32];
+  auto append = [&output](bool error, const char* text, std::size_t size) {
+    if (output.empty() || output.back().error != error) {
+      output.push_back({error, {}});
+    }
+    output.back().text.append(text, size);
+  };
+  while (begin < end) {
+    const char* line_end = std::find(begin, end, '\n');
+    if (line_end != begin) {
+      line.assign(begin, line_end);
+      try {
+        double result = calc.evaluate(line);
+        // "%g" is what operator<< prints for a double by default.
+        int size = std::snprintf(number, sizeof(number), "%g\n", result);
+        append(false, number, static_cast<std::size_t>(size));
+      } catch (const std::runtime_error& e) {
+        std::string message = std::string("Error: ") + e.what() + "\n";
+        append(true, message.data(), message.size());
+      }
+    }
+    begin = line_end == end ? end : line_end + 1;
+  }
+}
+
+// Batch version of test(): reads `input` in large blocks and splits the
+// complete lines of each block into one contiguous range per thread. Every
+// thread has its own calculator and output buffer; the buffers are written
+// in input order, so both streams receive the same lines as from test().
+void batchEvaluate(std::istream& input, std::ostream& out, std::ostream& err,
+                   int threads, std::size_t chunk_bytes = kBatchChunkBytes) {
+  threads = std::max(threads, 1);
+  std::vector<RPNCalculator> calculators(threads);
+  std::vector<std::vector<BatchOutput>> outputs(threads);
+  std::vector<std::size_t> bounds(threads + 1);
+  std::string buffer;
+  std::size_t carry = 0;
+  bool at_end = false;
+  std::ostream* last_stream = nullptr;
+
+  while (!at_end) {
+    buffer.resize(carry + chunk_bytes);
+    input.read(&buffer[carry], static_cast<std::streamsize>(chunk_bytes));
+    std::size_t size = carry + static_cast<std::size_t>(input.gcount());
+    at_end = !input;
+    std::size_t complete = size;
+    if (!at_end) {
+      std::size_t newline = size == 0 ? std::string::npos
+                                      : buffer.rfind('\n', size - 1);
+      if (newline == std::string::npos) {
+        // A single line longer than the block; keep reading.
+        carry = size;
+        continue;
+      }
+      complete = newline + 1;
+    }
+
+    bounds[0] = 0;
+    for (int thread = 1; thread < threads; ++thread) {
+      std::size_t bound =
+          std::max(complete * thread / threads, bounds[thread - 1]);
+      while (bound > 0 && bound < complete && buffer[bound - 1] != '\n') {
+        ++bound;
+      }
+      bounds[thread] = bound;
+    }
+    bounds[threads] = complete;
+
+    auto work = [&](int thread) {
+      outputs[thread].clear();
+      evaluateLines(buffer.data() + bounds[thread],
+                    buffer.data() + bounds[thread + 1], calculators[thread],
+                    outputs[thread]);
+    };
+    std::vector<std::thread> workers;
+    for (int thread = 1; thread < threads; ++thread) {
+      workers.emplace_back(work, thread);
+    }
+    work(0);
+    for (auto& worker : workers) {
+      worker.join();
+    }
+
+    for (const auto& output : outputs) {
+      for (const BatchOutput& part : output) {
+        std::ostream* stream = part.error ? &err : &out;
+        if (last_stream != nullptr && last_stream != stream) {
+          last_stream->flush();
+        }
+        stream->write(part.text.data(),
+                      static_cast<std::streamsize>(part.text.size()));
+        last_stream = stream;
+      }
+    }
+
+    carry = size - complete;
+    std::copy(buffer.begin() + complete, buffer.begin() + size, buffer.begin());
+  }
+  out.flush();
+  err.flush();
+}
+
+const std::vector<std::string> kSampleExpressions = {
+    "1 2 +",
+    "3 4 * 5 -",
+    "2 3.14159265358979 * 0.5 * sin",
+    "1 2 3 median 4 5 6 median atan2",
+    "2 10 pow sqrt 3 / log",
+    "0.5 cos 0.5 sin / 0.25 ctg + exp",
+    "1 2 + 3 4 + * 5 6 + 7 8 + * / tg",
+};
+
+void testCompiled() {
+  RPNCalculator calc;
+  for (const std::string& expression : kSampleExpressions) {
+    CompiledExpression compiled = calc.compile(expression);
+    assert(calc.run(compiled) == calc.evaluate(expression));
+  }
+
+  auto compile_error = [&calc](const std::string& expression) {
+    try {
+      (void)calc.compile(expression);
+    } catch (const std::runtime_error& e) {
+      return std::string(e.what());
+    }
+    return std::string();
+  };
+  assert(compile_error("1 +") == "not enough operands");
+  assert(compile_error("1 2") == "too many operands");
+  assert(compile_error("") == "no result");
+  assert(compile_error("1 foo +") == "invalid token: foo");
+  assert(compile_error("1e999") == "number out of range: 1e999");
+
+  auto run_error = [&calc](const std::string& expression) {
+    try {
+      (void)calc.run(calc.compile(expression));
+    } catch (const std::runtime_error& e) {
+      return std::string(e.what());
+    }
+    return std::string();
+  };
+  assert(run_error("1 0 /") == "operation error: division by zero");
+  assert(run_error("0 log") == "operation error: log domain error");
+  assert(run_error("-1 sqrt") == "operation error: sqrt domain error");
+  // A failed expression leaves nothing behind for the next one.
+  try {
+    (void)calc.evaluate("1 2 foo");
+  } catch (const std::runtime_error&) {
+  }
+  assert(calc.evaluate("5") == 5);
+}
+
+void testBatchEvaluate() {
+  std::string input;
+  const std::string lines[] = {"1 2 +", "", "3 sin", "1 0 /", "  4\t5 *  ",
+                               "1 2", "foo", "2 0.5 pow", "\r", "0 log",
+                               "1 2 3 median"};
+  for (int repeat = 0; repeat < 200; ++repeat) {
+    for (const std::string& line : lines) {
+      input += line;
+      input += '\n';
+    }
+    input += std::to_string(repeat) + " 7 /\n";
+  }
+  input += "42";
+
+  std::ostringstream expected_out, expected_err;
+  {
+    RPNCalculator calc;
+    std::istringstream lines_in(input);
+    std::string line;
+    while (std::getline(lines_in, line)) {
+      if (line.empty()) continue;
+      try {
+        expected_out << calc.evaluate(line) << "\n";
+      } catch (const std::runtime_error& e) {
+        expected_err << "Error: " << e.what() << "\n";
+      }
+    }
+  }
+  for (std::size_t chunk :
+       {std::size_t{3}, std::size_t{100}, kBatchChunkBytes}) {
+    for (int threads : {1, 2, 5}) {
+      std::istringstream in(input);
+      std::ostringstream out, err;
+      batchEvaluate(in, out, err, threads, chunk);
+      assert(out.str() == expected_out.str());
+      assert(err.str() == expected_err.str());
+    }
+  }
+}
+
+void testOptimize() {
+  RPNCalculator calc;
+  const std::vector<std::string> variables = {"x", "y"};
+  auto steps = [&](const std::string& expression) {
+    return optimize(calc.compile(expression, variables)).steps.size();
+  };
+  assert(steps("2 3.14159265358979 * x *") == 1);
+  assert(steps("x y * 3 +") == 1);
+  assert(steps("3 x y * +") == 1);
+  assert(steps("x sin x cos +") == 2);
+  assert(steps("x y + sin x y + sin *") == 3);
+  assert(steps("1 2 + 3 *") == 0);
+
+  const std::vector<std::string> expressions = {
+      "x y * 3 + sin",
+      "2 3.14159265358979 * x * sin 2 3.14159265358979 * x * cos atan2",
+      "x sin x cos / x sin x cos * + y -",
+      "x y + 2 pow x y + sqrt x y * x y * + median",
+      "x 2 * y 3 * + x 2 * y 3 * * +",
+      "1 2 + 4 * x log y exp * +",
+      "x y / x y / x y / + +",
+  };
+  for (const std::string& expression : expressions) {
+    CompiledExpression compiled = calc.compile(expression, variables);
+    OptimizedExpression optimized = optimize(compiled);
+    for (double x : {0.5, 1.0, 2.5, 7.0}) {
+      for (double y : {0.25, 1.5, 3.0}) {
+        double values[] = {x, y};
+        assert(calc.run(optimized, values) == calc.run(compiled, values));
+      }
+    }
+  }
+  for (const std::string& expression : kSampleExpressions) {
+    assert(calc.run(optimize(calc.compile(expression))) ==
+           calc.evaluate(expression));
+  }
+
+  auto run_error = [&](const std::string& expression, double x, double y) {
+    double values[] = {x, y};
+    try {
+      (void)calc.run(optimize(calc.compile(expression, variables)), values);
+    } catch (const std::runtime_error& e) {
+      return std::string(e.what());
+    }
+    return std::string();
+  };
+  assert(run_error("1 0 / x +", 1, 1) == "operation error: division by zero");
+  assert(run_error("x log y 0 / +", -1, 1) ==
+         "operation error: log domain error");
+  assert(run_error("x log y 0 / +", 1, 1) ==
+         "operation error: division by zero");
+  assert(run_error("x sqrt x sqrt +", -4, 0) ==
+         "operation error: sqrt domain error");
+  assert(run_error("x y 0 * / 3 +", 1, 1) ==
+         "operation error: division by zero");
+
+  try {
+    (void)optimize(CompiledExpression());
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "no result");
+  }
+  try {
+    (void)calc.run(OptimizedExpression());
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "no result");
+  }
+}
+
+void testJit() {
+  RPNCalculator calc;
+  const std::vector<std::string> variables = {"x", "y"};
+  const double nan = std::nan("");
+  auto same = [](double a, double b) {
+    return a == b || (std::isnan(a) && std::isnan(b));
+  };
+  // The value or the error, so that both backends can be compared on
+  // inputs where they throw.
+  auto outcome = [&](auto&& run) {
+    try {
+      char text[64];
+      std::snprintf(text, sizeof(text), "%a", run());
+      return std::string(text);
+    } catch (const std::runtime_error& e) {
+      return std::string(e.what());
+    }
+  };
+  for (const std::string& expression : kSampleExpressions) {
+    JitExpression jit(calc.compile(expression));
+    assert(jit.native() == static_cast<bool>(RPN_NATIVE_JIT));
+    assert(same(calc.run(jit), calc.evaluate(expression)));
+  }
+  const std::vector<std::string> expressions = {
+      "x y + 2 * x y - /",
+      "x sin y cos * x tg y ctg + -",
+      "x exp y log + x y atan2 x y pow * +",
+      "x y 3 median x 2 y median y x 0 median + +",
+      "x x * y y * + sqrt",
+      "1e308 x * 1e308 *",
+      "x 1 - sqrt y 1 - log -",
+      "x 1 - y 1 - /",
+  };
+  for (const std::string& expression : expressions) {
+    CompiledExpression compiled = calc.compile(expression, variables);
+    JitExpression jit(compiled);
+    for (double x : {0.5, 1.0, 2.5, 7.0, nan}) {
+      for (double y : {0.25, 1.5, 3.0, nan}) {
+        double values[] = {x, y};
+        assert(outcome([&] { return calc.run(jit, values); }) ==
+               outcome([&] { return calc.run(compiled, values); }));
+      }
+    }
+  }
+
+  auto run_error = [&](const std::string& expression, double x, double y) {
+    double values[] = {x, y};
+    try {
+      (void)calc.run(JitExpression(calc.compile(expression, variables)),
+                     values);
+    } catch (const std::runtime_error& e) {
+      return std::string(e.what());
+    }
+    return std::string();
+  };
+  assert(run_error("x y /", 1, 0) == "operation error: division by zero");
+  assert(run_error("x y /", 1, -0.0) == "operation error: division by zero");
+  assert(run_error("x y /", 1, nan).empty());
+  assert(run_error("x log", 0, 0) == "operation error: log domain error");
+  assert(run_error("x log", -1, 0) == "operation error: log domain error");
+  assert(run_error("x log", nan, 0).empty());
+  assert(run_error("x sqrt", -4, 0) == "operation error: sqrt domain error");
+  assert(run_error("x sqrt", -0.0, 0).empty());
+  assert(run_error("x log y 0 / +", -1, 1) ==
+         "operation error: log domain error");
+  assert(run_error("x log y 0 / +", 1, 1) ==
+         "operation error: division by zero");
+
+  // A failed run leaves the calculator usable.
+  JitExpression jit(calc.compile("x 1 +", variables));
+  double values[] = {2, 0};
+  assert(calc.run(jit, values) == 3);
+  JitExpression moved = std::move(jit);
+  assert(!jit.native() && calc.run(moved, values) == 3);
+
+  JitExpression never_compiled;
+  JitExpression compiled_empty{CompiledExpression()};
+  assert(!compiled_empty.native());
+  for (const JitExpression* empty : {&jit, &never_compiled, &compiled_empty}) {
+    try {
+      (void)calc.run(*empty, values);
+      assert(false);
+    } catch (const std::runtime_error& e) {
+      assert(std::string(e.what()) == "no result");
+    }
+  }
+  try {
+    (void)calc.run(CompiledExpression());
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "no result");
+  }
+}
+
+void testAllocations() {
+  if (!kCountsAllocations) return;
+  RPNCalculator calc;
+  std::vector<CompiledExpression> compiled;
+  for (const std::string& expression : kSampleExpressions) {
+    (void)calc.evaluate(expression);
+    compiled.push_back(calc.compile(expression));
+    (void)calc.run(compiled.back());
+  }
+  std::vector<double> xs(1000, 0.5), out(1000);
+  CompiledExpression batch = calc.compile("x 2 x median sin", {"x"});
+  std::vector<const double*> columns = {xs.data()};
+  calc.runBatch(batch, columns, xs.size(), out.data());
+
+  std::size_t allocations_before = allocationCount();
+  for (int repeat = 0; repeat < 10; ++repeat) {
+    for (std::size_t i = 0; i < kSampleExpressions.size(); ++i) {
+      (void)calc.evaluate(kSampleExpressions[i]);
+      (void)calc.run(compiled[i]);
+    }
+    calc.runBatch(batch, columns, xs.size(), out.data());
+  }
+  assert(allocationCount() == allocations_before);
+}
+
+void testVariables() {
+  RPNCalculator calc;
+  CompiledExpression sum_sin = calc.compile("x y + sin", {"x", "y"});
+  double point[] = {0.25, 1.5};
+  assert(calc.run(sum_sin, point) == std::sin(0.25 + 1.5));
+
+  const std::vector<std::string> expressions = {
+      "x y + sin", "x 2 pow y 2 pow + sqrt", "x y 0.5 median x atan2 cos",
+      "y exp x / 3 - x *"};
+  const std::size_t kCount = 1000;
+  std::vector<double> xs(kCount), ys(kCount), out(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    xs[i] = 0.01 * static_cast<double>(i) + 0.5;
+    ys[i] = std::cos(static_cast<double>(i));
+  }
+  for (const std::string& expression : expressions) {
+    CompiledExpression compiled = calc.compile(expression, {"x", "y"});
+    calc.runBatch(compiled, {xs.data(), ys.data()}, kCount, out.data());
+    for (std::size_t i = 0; i < kCount; ++i) {
+      double values[] = {xs[i], ys[i]};
+      assert(out[i] == calc.run(compiled, values));
+    }
+  }
+
+  try {
+    (void)calc.compile("x z +", {"x"});
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "invalid token: z");
+  }
+  ys[700] = -1;
+  try {
+    calc.runBatch(calc.compile("x y sqrt +", {"x", "y"}),
+                  {xs.data(), ys.data()}, kCount, out.data());
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "operation error: sqrt domain error");
+  }
+  try {
+    calc.runBatch(CompiledExpression(), {}, kCount, out.data());
+    assert(false);
+  } catch (const std::runtime_error& e) {
+    assert(std::string(e.what()) == "no result");
+  }
+}
+
+template <typename Function>
+double nanosecondsPerCall(int calls, Function&& function) {
+  auto start = std::chrono::steady_clock::now();
+  for (int call = 0; call < calls; ++call) {
+    function();
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / calls;
+}
+
+void benchmarkBatch() {
+  const std::size_t kCount = 1 << 20;
+  RPNCalculator calc;
+  std::vector<double> xs(kCount), ys(kCount), out(kCount);
+  for (std::size_t i = 0; i < kCount; ++i) {
+    xs[i] = 1.0 + static_cast<double>(i % 1000) / 7;
+    ys[i] = 2.0 - static_cast<double>(i % 333) / 11;
+  }
+  for (const std::string expression :
+       {"x y + 2 *", "x y * x / y -", "x y + sin", "x log y x pow +"}) {
+    CompiledExpression compiled = calc.compile(expression, {"x", "y"});
+    double scalar_ns = nanosecondsPerCall(1, [&] {
+      for (std::size_t i = 0; i < kCount; ++i) {
+        double values[] = {xs[i], ys[i]};
+        out[i] = calc.run(compiled, values);
+      }
+    });
+    double batch_ns = nanosecondsPerCall(1, [&] {
+      calc.runBatch(compiled, {xs.data(), ys.data()}, kCount, out.data());
+    });
+    std::cout << expression << "\n  run " << scalar_ns / kCount
+              << " ns/element, runBatch " << batch_ns / kCount
+              << " ns/element (x" << scalar_ns / batch_ns << ")\n";
+  }
+}
+
+void benchmark() {
+  const int kCalls = 200000;
+  RPNCalculator calc;
+  volatile double sink = 0;
+  for (const std::string& expression : kSampleExpressions) {
+    // Let the scratch buffers grow before counting.
+    (void)calc.evaluate(expression);
+    std::size_t allocations_before = allocationCount();
+    double evaluate_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.evaluate(expression); });
+    double evaluate_allocations =
+        static_cast<double>(allocationCount() - allocations_before) / kCalls;
+    double compile_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.compile(expression).max_depth; });
+    CompiledExpression compiled = calc.compile(expression);
+    (void)calc.run(compiled);
+    allocations_before = allocationCount();
+    double run_ns =
+        nanosecondsPerCall(kCalls, [&] { sink = sink + calc.run(compiled); });
+    double run_allocations =
+        static_cast<double>(allocationCount() - allocations_before) / kCalls;
+    auto allocations = [](double count) {
+      std::ostringstream text;
+      if (kCountsAllocations) text << " (" << count << " allocations)";
+      return text.str();
+    };
+    std::cout << expression << "\n  evaluate " << evaluate_ns << " ns"
+              << allocations(evaluate_allocations) << ", compile "
+              << compile_ns << " ns, run " << run_ns << " ns"
+              << allocations(run_allocations) << ", x"
+              << evaluate_ns / run_ns << "\n";
+  }
+}
+
+void benchmarkOptimize() {
+  const int kCalls = 500000;
+  RPNCalculator calc;
+  volatile double sink = 0;
+  for (const std::string expression :
+       {"2 3.14159265358979 * x * sin 2 3.14159265358979 * x * cos +",
+        "x y * 1 + x y * 2 + *", "x 2 * y 3 * + x 2 * y 3 * * + sqrt"}) {
+    CompiledExpression compiled = calc.compile(expression, {"x", "y"});
+    OptimizedExpression optimized = optimize(compiled);
+    double values[] = {0.75, 1.25};
+    double run_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.run(compiled, values); });
+    double optimized_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.run(optimized, values); });
+    std::cout << expression << "\n  " << compiled.code.size()
+              << " instructions: " << run_ns << " ns, "
+              << optimized.steps.size() << " optimised steps: "
+              << optimized_ns << " ns (x" << run_ns / optimized_ns << ")\n";
+  }
+}
+
+void benchmarkJit() {
+  const int kCalls = 1000000;
+  RPNCalculator calc;
+  volatile double sink = 0;
+  for (const std::string expression :
+       {"x y + 2 * x y - /", "x x * y y * + sqrt x y atan2 *",
+        "x 2 * y 3 * + x 2 * y 3 * * + sqrt"}) {
+    CompiledExpression compiled = calc.compile(expression, {"x", "y"});
+    JitExpression jit(compiled);
+    double values[] = {0.75, 1.25};
+    double run_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.run(compiled, values); });
+    double jit_ns = nanosecondsPerCall(
+        kCalls, [&] { sink = sink + calc.run(jit, values); });
+    std::cout << expression << "\n  run " << run_ns << " ns, "
+              << (jit.native() ? "native " : "interpreted ") << jit_ns
+              << " ns (x" << run_ns / jit_ns << ")\n";
+  }
+}
+
+void benchmarkStreaming() {
+  std::string input;
+  for (int line = 0; line < 300000; ++line) {
+    input += kSampleExpressions[line % kSampleExpressions.size()];
+    input += '\n';
+  }
+  int max_threads =
+      std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int threads = 1; threads <= max_threads; threads *= 2) {
+    std::istringstream in(input);
+    std::ostringstream out, err;
+    double ns = nanosecondsPerCall(
+        1, [&] { batchEvaluate(in, out, err, threads); });
+    std::cout << "batch of 300000 lines, " << threads << " threads: "
+              << 300000 / (ns * 1e-9) << " lines/s\n";
+  }
+}
+
+int main(int argc, char* argv[]) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  if (mode == "--test") {
+    testCompiled();
+    testVariables();
+    testAllocations();
+    testBatchEvaluate();
+    testOptimize();
+    testJit();
+    return 0;
+  }
+  if (mode == "--bench") {
+    benchmark();
+    benchmarkBatch();
+    benchmarkStreaming();
+    benchmarkOptimize();
+    benchmarkJit();
+    return 0;
+  }
+  if (mode == "--batch" && argc > 2) {
+    int threads = static_cast<int>(std::thread::hardware_concurrency());
+    if (argc > 4 && std::string(argv[3]) == "--threads") {
+      threads = std::stoi(argv[4]);
+    }
+    std::string path = argv[2];
+    if (path == "-") {
+      batchEvaluate(std::cin, std::cout, std::cerr, threads);
+      return 0;
+    }
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+      std::cerr << "Error: cannot open " << path << std::endl;
+      return 1;
+    }
+    batchEvaluate(file, std::cout, std::cerr, threads);
+    return 0;
+  }
   test();
   return 0;
 }
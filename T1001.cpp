@@ -1,14 +1,182 @@
+#include <algorithm>
+#include <array>
+#include <bitset>
+#include <cassert>
+#include <cerrno>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
 #include <iostream>
+#include <mutex>
 #include <random>
+#include <string>
+#include <string_view>
 #include <thread>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Draws a board to the terminal. A frame is assembled in one reused buffer
+// and written with a single write(). In diff mode only the cells that changed
+// since the previous frame are sent, each run of them behind a cursor
+// positioning escape sequence. Frames are paced to at most `max_fps`; zero
+// or less means unpaced.
+class TerminalRenderer {
+ public:
+  explicit TerminalRenderer(double max_fps = 1.0, bool diff = false)
+      : diff(diff),
+        frame_interval(max_fps > 0
+                           ? std::chrono::duration_cast<
+                                 std::chrono::steady_clock::duration>(
+                                 std::chrono::duration<double>(1.0 / max_fps))
+                           : std::chrono::steady_clock::duration::zero()) {}
+
+  // `cell(width_pos, length_pos)` returns the character to show.
+  template <typename Cell>
+  void draw(int width, int length, Cell&& cell) {
+    std::size_t full_size = static_cast<std::size_t>(width) * (length + 1) + 2;
+    frame.clear();
+    frame.reserve(full_size + kHome.size());
+    bool redraw = !diff || width != shown_width || length != shown_length;
+    if (redraw) {
+      shown.assign(static_cast<std::size_t>(width) * length, ' ');
+      shown_width = width;
+      shown_length = length;
+      if (diff) {
+        frame += kClear;
+      }
+    }
+    if (diff && !redraw) {
+      append_changes(width, length, cell);
+      // A busy frame is cheaper to send whole.
+      if (frame.size() > full_size) {
+        frame.clear();
+        redraw = true;
+      }
+    }
+    if (redraw) {
+      if (diff) {
+        frame += kHome;
+      }
+      for (int width_iter = 0; width_iter < width; ++width_iter) {
+        char* row =
+            shown.data() + static_cast<std::size_t>(width_iter) * length;
+        for (int length_iter = 0; length_iter < length; ++length_iter) {
+          row[length_iter] = cell(width_iter, length_iter);
+          frame += row[length_iter];
+        }
+        frame += '\n';
+      }
+      if (!diff) {
+        frame += "\n\n";
+      }
+    }
+    write_frame();
+    wait_for_next_frame();
+  }
+
+ private:
+  static constexpr std::string_view kClear = "\x1b[2J";
+  static constexpr std::string_view kHome = "\x1b[H";
+
+  bool diff;
+  std::chrono::steady_clock::duration frame_interval;
+  std::chrono::steady_clock::time_point next_frame;
+  std::string frame;
+  std::vector<char> shown;
+  int shown_width = -1;
+  int shown_length = -1;
+
+  template <typename Cell>
+  void append_changes(int width, int length, Cell& cell) {
+    for (int width_iter = 0; width_iter < width; ++width_iter) {
+      char* row = shown.data() + static_cast<std::size_t>(width_iter) * length;
+      // The cursor advances by itself while a run of changed cells continues.
+      int cursor = -1;
+      for (int length_iter = 0; length_iter < length; ++length_iter) {
+        char value = cell(width_iter, length_iter);
+        if (value == row[length_iter]) {
+          continue;
+        }
+        row[length_iter] = value;
+        if (cursor != length_iter) {
+          frame += "\x1b[";
+          frame += std::to_string(width_iter + 1);
+          frame += ';';
+          frame += std::to_string(length_iter + 1);
+          frame += 'H';
+        }
+        frame += value;
+        cursor = length_iter + 1;
+      }
+    }
+    frame += "\x1b[";
+    frame += std::to_string(width + 1);
+    frame += ";1H";
+  }
+
+  void write_frame() {
+    std::cout.flush();
+#if defined(__unix__) || defined(__APPLE__)
+    const char* data = frame.data();
+    std::size_t left = frame.size();
+    while (left > 0) {
+      ssize_t written = ::write(STDOUT_FILENO, data, left);
+      if (written < 0 && errno == EINTR) {
+        continue;
+      }
+      if (written <= 0) {
+        return;
+      }
+      data += written;
+      left -= static_cast<std::size_t>(written);
+    }
+#else
+    std::fwrite(frame.data(), 1, frame.size(), stdout);
+    std::fflush(stdout);
+#endif
+  }
+
+  void wait_for_next_frame() {
+    if (frame_interval == std::chrono::steady_clock::duration::zero()) {
+      return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    next_frame = std::max(next_frame, now) + frame_interval;
+    std::this_thread::sleep_until(next_frame);
+  }
+};
+
 class Life {
  public:
-  void random_fill(double fill_percentage = 0.5) {
-    std::random_device rd;
-    std::mt19937 gen(rd());
+  using charmatrix = std::vector<std::vector<char>>;
+
+  Life() = default;
+
+  Life(int new_width, int new_length) : width(new_width), length(new_length) {}
+
+  explicit Life(charmatrix initial_field)
+      : width(static_cast<int>(initial_field.size())),
+        length(initial_field.empty()
+                   ? 0
+                   : static_cast<int>(initial_field[0].size())),
+        field(std::move(initial_field)) {}
+
+  void random_fill(double fill_percentage = 0.5,
+                   unsigned seed = std::random_device{}()) {
+    std::mt19937 gen(seed);
     std::uniform_real_distribution<> dis(0.0, 1.0);
     for (int width_iter = 0; width_iter < width; ++width_iter) {
       for (int length_iter = 0; length_iter < length; ++length_iter) {
@@ -27,22 +195,32 @@ class Life {
     print_field();
   }
 
- private:
-  using charmatrix = std::vector<std::vector<char>>;
+  // Advances one generation without printing.
+  void step() { next_state(); }
+
+  [[nodiscard]] const charmatrix& get_field() const { return field; }
+
+  // A headless game neither prints nor sleeps, so update() can be timed.
+  void set_headless(bool value) { headless = value; }
 
+  void set_renderer(const TerminalRenderer& new_renderer) {
+    renderer = new_renderer;
+  }
+
+ private:
   int width = 10;
   int length = 10;
   charmatrix field = charmatrix(width, std::vector<char>(length, '#'));
+  bool headless = false;
+  TerminalRenderer renderer;
 
-  void print_field() const {
-    for (int width_iter = 0; width_iter < width; ++width_iter) {
-      for (int length_iter = 0; length_iter < length; ++length_iter) {
-        std::cout << field[width_iter][length_iter];
-      }
-      std::cout << "\n";
+  void print_field() {
+    if (headless) {
+      return;
     }
-    std::cout << "\n\n";
-    std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+    renderer.draw(width, length, [this](int width_pos, int length_pos) {
+      return field[width_pos][length_pos];
+    });
   }
 
   void next_state() {
@@ -93,7 +271,1085 @@ class Life {
   }
 };
 
-int main() {
+// Bitwise operations shared by the scalar and the AVX2 kernel.
+inline std::uint64_t and_not(std::uint64_t mask, std::uint64_t value) {
+  return ~mask & value;
+}
+
+#ifdef __AVX2__
+struct Lanes256 {
+  __m256i bits;
+
+  friend Lanes256 operator&(Lanes256 left, Lanes256 right) {
+    return {_mm256_and_si256(left.bits, right.bits)};
+  }
+  friend Lanes256 operator|(Lanes256 left, Lanes256 right) {
+    return {_mm256_or_si256(left.bits, right.bits)};
+  }
+  friend Lanes256 operator^(Lanes256 left, Lanes256 right) {
+    return {_mm256_xor_si256(left.bits, right.bits)};
+  }
+};
+
+inline Lanes256 and_not(Lanes256 mask, Lanes256 value) {
+  return {_mm256_andnot_si256(mask.bits, value.bits)};
+}
+#endif
+
+// Applies the Life rule to 64 (or 256) cells at once. Every argument holds the
+// same neighbour of all the cells, e.g. `up_left` has bit j set when the cell
+// above and to the left of cell j is alive. The eight neighbours are summed
+// with a tree of full adders into `ones`, `twos` and `fours` (four or more).
+template <typename Word>
+Word life_rule(Word up_left, Word up, Word up_right, Word left, Word self,
+               Word right, Word down_left, Word down, Word down_right) {
+  Word up_xor = up_left ^ up;
+  Word up_sum = up_xor ^ up_right;
+  Word up_carry = (up_left & up) | (up_right & up_xor);
+  Word middle_sum = left ^ right;
+  Word middle_carry = left & right;
+  Word down_xor = down_left ^ down;
+  Word down_sum = down_xor ^ down_right;
+  Word down_carry = (down_left & down) | (down_right & down_xor);
+
+  Word ones_xor = up_sum ^ middle_sum;
+  Word ones = ones_xor ^ down_sum;
+  Word ones_carry = (up_sum & middle_sum) | (down_sum & ones_xor);
+
+  Word twos_xor = up_carry ^ middle_carry;
+  Word twos_partial = twos_xor ^ down_carry;
+  Word fours =
+      (up_carry & middle_carry) | (down_carry & twos_xor) |
+      (twos_partial & ones_carry);
+  Word twos = twos_partial ^ ones_carry;
+
+  // Exactly three neighbours, or exactly two and already alive.
+  return and_not(fours, twos & (ones | self));
+}
+
+// A second Life engine over the same bounded board: one bit per cell in
+// contiguous 64-bit words. Every row is padded with a zero word on both sides
+// and the board with a zero row above and below, so the kernel reads
+// neighbours without bounds checks. Two buffers are kept and swapped each
+// generation, so stepping never allocates.
+class BitLife {
+ public:
+  explicit BitLife(const Life::charmatrix& field)
+      : width(static_cast<int>(field.size())),
+        length(field.empty() ? 0 : static_cast<int>(field[0].size())),
+        words((length + 63) / 64),
+        stride(words + 2) {
+    for (auto& buffer : buffers) {
+      buffer.assign(static_cast<std::size_t>(width + 2) * stride, 0);
+    }
+    tail_mask = (length % 64 == 0) ? ~std::uint64_t{0}
+                                   : (std::uint64_t{1} << (length % 64)) - 1;
+    for (int width_iter = 0; width_iter < width; ++width_iter) {
+      std::uint64_t* row = row_of(current, width_iter);
+      for (int length_iter = 0; length_iter < length; ++length_iter) {
+        if (field[width_iter][length_iter] == '#') {
+          row[length_iter / 64] |= std::uint64_t{1} << (length_iter % 64);
+        }
+      }
+    }
+  }
+
+  void step() {
+    step_rows(0, width);
+    flip();
+  }
+
+  // Writes the next generation of rows [row_begin, row_end) into the back
+  // buffer. The front buffer is only read, so disjoint row ranges may be
+  // stepped concurrently; call flip() once the whole board is done.
+  void step_rows(int row_begin, int row_end) {
+    step_block(row_begin, row_end, 0, words);
+  }
+
+  // Same as step_rows() for the words [word_begin, word_end) of each row.
+  void step_block(int row_begin, int row_end, int word_begin, int word_end) {
+    for (int row = row_begin; row < row_end; ++row) {
+      step_row(row, word_begin, word_end);
+    }
+  }
+
+  // Whether the back buffer differs from the front one inside the block,
+  // i.e. whether a freshly stepped block changed.
+  [[nodiscard]] bool block_changed(int row_begin, int row_end, int word_begin,
+                                   int word_end) const {
+    std::uint64_t difference = 0;
+    for (int row = row_begin; row < row_end; ++row) {
+      const std::uint64_t* front = row_of(current, row);
+      const std::uint64_t* back = row_of(current ^ 1, row);
+      for (int word = word_begin; word < word_end; ++word) {
+        difference |= front[word] ^ back[word];
+      }
+    }
+    return difference != 0;
+  }
+
+  void flip() { current ^= 1; }
+
+  [[nodiscard]] bool is_alive(int width_pos, int length_pos) const {
+    const std::uint64_t* row = row_of(current, width_pos);
+    return (row[length_pos / 64] >> (length_pos % 64)) & 1;
+  }
+
+  [[nodiscard]] Life::charmatrix to_field() const {
+    Life::charmatrix field(width, std::vector<char>(length, ' '));
+    for (int width_iter = 0; width_iter < width; ++width_iter) {
+      for (int length_iter = 0; length_iter < length; ++length_iter) {
+        if (is_alive(width_iter, length_iter)) {
+          field[width_iter][length_iter] = '#';
+        }
+      }
+    }
+    return field;
+  }
+
+  [[nodiscard]] int get_width() const { return width; }
+  [[nodiscard]] int get_length() const { return length; }
+  [[nodiscard]] int get_words() const { return words; }
+
+  [[nodiscard]] std::uint64_t population() const {
+    std::uint64_t count = 0;
+    for (int width_iter = 0; width_iter < width; ++width_iter) {
+      const std::uint64_t* row = row_of(current, width_iter);
+      for (int word = 0; word < words; ++word) {
+        count += std::bitset<64>(row[word]).count();
+      }
+    }
+    return count;
+  }
+
+ private:
+  int width;
+  int length;
+  int words;
+  int stride;
+  std::uint64_t tail_mask = 0;
+  std::array<std::vector<std::uint64_t>, 2> buffers;
+  int current = 0;
+
+  [[nodiscard]] std::uint64_t* row_of(int buffer, int width_pos) {
+    return buffers[buffer].data() +
+           static_cast<std::size_t>(width_pos + 1) * stride + 1;
+  }
+
+  [[nodiscard]] const std::uint64_t* row_of(int buffer, int width_pos) const {
+    return buffers[buffer].data() +
+           static_cast<std::size_t>(width_pos + 1) * stride + 1;
+  }
+
+  void step_row(int width_pos, int word_begin, int word_end) {
+    const std::uint64_t* up = row_of(current, width_pos - 1);
+    const std::uint64_t* mid = row_of(current, width_pos);
+    const std::uint64_t* down = row_of(current, width_pos + 1);
+    std::uint64_t* out = row_of(current ^ 1, width_pos);
+    int word = word_begin;
+#ifdef __AVX2__
+    auto load = [](const std::uint64_t* at) {
+      return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(at));
+    };
+    // Bit j of the left neighbour word is bit j - 1 of the row, so it comes
+    // from the top bit of the previous word for j == 0.
+    auto left_of = [&](const std::uint64_t* at) {
+      return Lanes256{_mm256_or_si256(_mm256_slli_epi64(load(at), 1),
+                                      _mm256_srli_epi64(load(at - 1), 63))};
+    };
+    auto right_of = [&](const std::uint64_t* at) {
+      return Lanes256{_mm256_or_si256(_mm256_srli_epi64(load(at), 1),
+                                      _mm256_slli_epi64(load(at + 1), 63))};
+    };
+    for (; word + 4 <= word_end; word += 4) {
+      Lanes256 next = life_rule(
+          left_of(up + word), Lanes256{load(up + word)}, right_of(up + word),
+          left_of(mid + word), Lanes256{load(mid + word)},
+          right_of(mid + word), left_of(down + word),
+          Lanes256{load(down + word)}, right_of(down + word));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + word), next.bits);
+    }
+#endif
+    auto left_of_word = [](const std::uint64_t* at) {
+      return (at[0] << 1) | (at[-1] >> 63);
+    };
+    auto right_of_word = [](const std::uint64_t* at) {
+      return (at[0] >> 1) | (at[1] << 63);
+    };
+    for (; word < word_end; ++word) {
+      out[word] = life_rule(left_of_word(up + word), up[word],
+                            right_of_word(up + word), left_of_word(mid + word),
+                            mid[word], right_of_word(mid + word),
+                            left_of_word(down + word), down[word],
+                            right_of_word(down + word));
+    }
+    if (word_end == words && word_end > word_begin) {
+      out[words - 1] &= tail_mask;
+    }
+  }
+};
+
+// Blocks until `count` threads have arrived, then runs `completion` on the
+// last one to arrive before releasing them all.
+class Barrier {
+ public:
+  Barrier(int count, std::function<void()> completion)
+      : count(count), remaining(count), completion(std::move(completion)) {}
+
+  void arrive_and_wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    std::uint64_t arrived_phase = phase;
+    if (--remaining == 0) {
+      completion();
+      remaining = count;
+      ++phase;
+      released.notify_all();
+      return;
+    }
+    released.wait(lock, [&] { return phase != arrived_phase; });
+  }
+
+ private:
+  int count;
+  int remaining;
+  std::uint64_t phase = 0;
+  std::function<void()> completion;
+  std::mutex mutex;
+  std::condition_variable released;
+};
+
+// Steps a BitLife board on a fixed pool of threads. Each thread owns one band
+// of rows; the threads meet at a barrier after every generation, where the
+// buffers are flipped. The calling thread works the first band.
+class ParallelLife {
+ public:
+  explicit ParallelLife(
+      const Life::charmatrix& field,
+      int thread_count = static_cast<int>(std::thread::hardware_concurrency()))
+      : life(field),
+        bands(std::clamp(thread_count, 1, std::max(life.get_width(), 1))),
+        barrier(bands, [this] { life.flip(); }) {
+    for (int band = 1; band < bands; ++band) {
+      workers.emplace_back([this, band] { work(band); });
+    }
+  }
+
+  ParallelLife(const ParallelLife&) = delete;
+  ParallelLife& operator=(const ParallelLife&) = delete;
+
+  ~ParallelLife() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    job_posted.notify_all();
+    for (auto& worker : workers) {
+      worker.join();
+    }
+  }
+
+  void run(std::uint64_t generations) {
+    if (generations == 0) {
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      job_generations = generations;
+      ++job_id;
+    }
+    job_posted.notify_all();
+    run_band(0, generations);
+  }
+
+  [[nodiscard]] const BitLife& state() const { return life; }
+  [[nodiscard]] int thread_count() const { return bands; }
+
+ private:
+  BitLife life;
+  int bands;
+  Barrier barrier;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable job_posted;
+  std::uint64_t job_id = 0;
+  std::uint64_t job_generations = 0;
+  bool stopping = false;
+
+  void run_band(int band, std::uint64_t generations) {
+    int row_begin = static_cast<int>(
+        static_cast<std::int64_t>(life.get_width()) * band / bands);
+    int row_end = static_cast<int>(
+        static_cast<std::int64_t>(life.get_width()) * (band + 1) / bands);
+    for (std::uint64_t generation = 0; generation < generations;
+         ++generation) {
+      life.step_rows(row_begin, row_end);
+      barrier.arrive_and_wait();
+    }
+  }
+
+  void work(int band) {
+    std::uint64_t seen_job = 0;
+    while (true) {
+      std::uint64_t generations;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        job_posted.wait(lock, [&] { return stopping || job_id != seen_job; });
+        if (stopping) {
+          return;
+        }
+        seen_job = job_id;
+        generations = job_generations;
+      }
+      run_band(band, generations);
+    }
+  }
+};
+
+// Steps a BitLife board tile by tile and skips every tile whose 3x3 tile
+// neighbourhood did not change in the previous generation: its next state is
+// its current state, which the back buffer already holds from two
+// generations ago. The cost of a generation follows the activity on the
+// board rather than its area.
+class TiledLife {
+ public:
+  static constexpr int kTileRows = 64;
+  static constexpr int kTileWords = 4;
+
+  explicit TiledLife(const Life::charmatrix& field)
+      : life(field),
+        tile_rows((life.get_width() + kTileRows - 1) / kTileRows),
+        tile_columns((life.get_words() + kTileWords - 1) / kTileWords),
+        changed(static_cast<std::size_t>(tile_rows) * tile_columns, 1),
+        next_changed(changed.size(), 0) {}
+
+  void step() {
+    active_tiles = 0;
+    for (int tile_row = 0; tile_row < tile_rows; ++tile_row) {
+      int row_begin = tile_row * kTileRows;
+      int row_end = std::min(row_begin + kTileRows, life.get_width());
+      for (int tile_column = 0; tile_column < tile_columns; ++tile_column) {
+        std::size_t tile =
+            static_cast<std::size_t>(tile_row) * tile_columns + tile_column;
+        if (!is_active(tile_row, tile_column)) {
+          next_changed[tile] = 0;
+          continue;
+        }
+        ++active_tiles;
+        int word_begin = tile_column * kTileWords;
+        int word_end = std::min(word_begin + kTileWords, life.get_words());
+        life.step_block(row_begin, row_end, word_begin, word_end);
+        next_changed[tile] =
+            life.block_changed(row_begin, row_end, word_begin, word_end);
+      }
+    }
+    life.flip();
+    changed.swap(next_changed);
+  }
+
+  [[nodiscard]] const BitLife& state() const { return life; }
+  // Number of tiles recomputed by the last step().
+  [[nodiscard]] std::size_t get_active_tiles() const { return active_tiles; }
+  [[nodiscard]] std::size_t get_tile_count() const { return changed.size(); }
+
+ private:
+  BitLife life;
+  int tile_rows;
+  int tile_columns;
+  std::vector<char> changed;
+  std::vector<char> next_changed;
+  std::size_t active_tiles = 0;
+
+  [[nodiscard]] bool is_active(int tile_row, int tile_column) const {
+    for (int row = std::max(tile_row - 1, 0);
+         row <= std::min(tile_row + 1, tile_rows - 1); ++row) {
+      for (int column = std::max(tile_column - 1, 0);
+           column <= std::min(tile_column + 1, tile_columns - 1); ++column) {
+        if (changed[static_cast<std::size_t>(row) * tile_columns + column]) {
+          return true;
+        }
+      }
+    }
+    return false;
+  }
+};
+
+// Hashlife: the board is a quadtree of canonical nodes (equal subtrees are
+// stored once) and the future of every node is memoized, so repetitive and
+// sparse patterns can be advanced by 2^k generations in a single call.
+// Hashlife works on the unbounded plane: it agrees with Life as long as the
+// pattern does not reach the border of the original field.
+class HashLife {
+ public:
+  // Unreachable nodes are collected once the table holds more than
+  // node_limit of them, so long chaotic runs stay in bounded memory.
+  explicit HashLife(const Life::charmatrix& field,
+                    std::size_t node_limit = std::size_t{1} << 22)
+      : node_limit(node_limit), next_collection(node_limit) {
+    nodes.push_back({0, 0, 0, 0, 0, 0});
+    nodes.push_back({0, 0, 0, 0, 0, 1});
+    empty_nodes.push_back(0);
+    int width = static_cast<int>(field.size());
+    int length = field.empty() ? 0 : static_cast<int>(field[0].size());
+    int level = 3;
+    while ((std::int64_t{1} << (level - 1)) < std::max(width, length)) {
+      ++level;
+    }
+    root = build(field, level, -(std::int64_t{1} << (level - 1)),
+                 -(std::int64_t{1} << (level - 1)));
+  }
+
+  void advance(std::uint64_t generations) {
+    for (int step_log = 0; generations != 0; ++step_log, generations >>= 1) {
+      if ((generations & 1) == 0) {
+        continue;
+      }
+      while (nodes[root].level < step_log + 3 || !is_padded(root)) {
+        root = pad(root);
+      }
+      root = successor(root, step_log);
+      generation += std::uint64_t{1} << step_log;
+      if (nodes.size() > next_collection) {
+        collect();
+      }
+    }
+  }
+
+  [[nodiscard]] bool is_alive(std::int64_t width_pos,
+                              std::int64_t length_pos) const {
+    std::int64_t half = std::int64_t{1} << (nodes[root].level - 1);
+    if (width_pos < -half || width_pos >= half || length_pos < -half ||
+        length_pos >= half) {
+      return false;
+    }
+    std::uint32_t node = root;
+    std::int64_t top = -half;
+    std::int64_t left = -half;
+    while (nodes[node].level > 0 && nodes[node].population != 0) {
+      half = std::int64_t{1} << (nodes[node].level - 1);
+      bool lower = width_pos >= top + half;
+      bool right = length_pos >= left + half;
+      top += lower ? half : 0;
+      left += right ? half : 0;
+      node = lower ? (right ? nodes[node].se : nodes[node].sw)
+                   : (right ? nodes[node].ne : nodes[node].nw);
+    }
+    return nodes[node].population != 0;
+  }
+
+  // The cells of [0, width) x [0, length), i.e. of the original field.
+  [[nodiscard]] Life::charmatrix to_field(int width, int length) const {
+    Life::charmatrix field(width, std::vector<char>(length, ' '));
+    for (int width_iter = 0; width_iter < width; ++width_iter) {
+      for (int length_iter = 0; length_iter < length; ++length_iter) {
+        if (is_alive(width_iter, length_iter)) {
+          field[width_iter][length_iter] = '#';
+        }
+      }
+    }
+    return field;
+  }
+
+  [[nodiscard]] std::uint64_t population() const {
+    return nodes[root].population;
+  }
+  [[nodiscard]] std::uint64_t get_generation() const { return generation; }
+  [[nodiscard]] std::size_t node_count() const { return nodes.size(); }
+
+ private:
+  // Leaves are nodes 0 (dead) and 1 (alive); a node of level k covers a
+  // 2^k x 2^k square and its children are the four quadrants.
+  struct Node {
+    std::uint32_t nw, ne, sw, se;
+    int level;
+    std::uint64_t population;
+  };
+
+  struct Children {
+    std::uint32_t nw, ne, sw, se;
+
+    bool operator==(const Children& other) const {
+      return nw == other.nw && ne == other.ne && sw == other.sw &&
+             se == other.se;
+    }
+  };
+
+  struct ChildrenHash {
+    std::size_t operator()(const Children& children) const {
+      std::uint64_t hash = children.nw;
+      hash = hash * 0x9E3779B97F4A7C15ULL + children.ne;
+      hash = hash * 0x9E3779B97F4A7C15ULL + children.sw;
+      hash = hash * 0x9E3779B97F4A7C15ULL + children.se;
+      return static_cast<std::size_t>(hash ^ (hash >> 29));
+    }
+  };
+
+  std::vector<Node> nodes;
+  std::unordered_map<Children, std::uint32_t, ChildrenHash> canonical;
+  // Keyed by node << 8 | step_log.
+  std::unordered_map<std::uint64_t, std::uint32_t> results;
+  std::vector<std::uint32_t> empty_nodes;
+  std::uint32_t root = 0;
+  std::uint64_t generation = 0;
+  std::size_t node_limit;
+  std::size_t next_collection;
+
+  std::uint32_t join(std::uint32_t nw, std::uint32_t ne, std::uint32_t sw,
+                     std::uint32_t se) {
+    auto [it, inserted] = canonical.try_emplace(
+        Children{nw, ne, sw, se}, static_cast<std::uint32_t>(nodes.size()));
+    if (inserted) {
+      nodes.push_back({nw, ne, sw, se, nodes[nw].level + 1,
+                       nodes[nw].population + nodes[ne].population +
+                           nodes[sw].population + nodes[se].population});
+    }
+    return it->second;
+  }
+
+  std::uint32_t empty(int level) {
+    while (static_cast<int>(empty_nodes.size()) <= level) {
+      std::uint32_t below = empty_nodes.back();
+      empty_nodes.push_back(join(below, below, below, below));
+    }
+    return empty_nodes[level];
+  }
+
+  std::uint32_t build(const Life::charmatrix& field, int level,
+                      std::int64_t top, std::int64_t left) {
+    std::int64_t size = std::int64_t{1} << level;
+    std::int64_t width = static_cast<std::int64_t>(field.size());
+    std::int64_t length = field.empty() ? 0 : field[0].size();
+    if (top >= width || left >= length || top + size <= 0 ||
+        left + size <= 0) {
+      return empty(level);
+    }
+    if (level == 0) {
+      return field[top][left] == '#' ? 1 : 0;
+    }
+    std::int64_t half = size / 2;
+    return join(build(field, level - 1, top, left),
+                build(field, level - 1, top, left + half),
+                build(field, level - 1, top + half, left),
+                build(field, level - 1, top + half, left + half));
+  }
+
+  // Keeps the nodes reachable from the root and the empty squares,
+  // renumbering them in their old order; children always precede their
+  // parents, so one pass remaps everything. Cached results may name dropped
+  // nodes and are discarded.
+  void collect() {
+    std::vector<char> reached(nodes.size(), 0);
+    reached[0] = reached[1] = 1;
+    std::vector<std::uint32_t> stack(empty_nodes.begin(), empty_nodes.end());
+    stack.push_back(root);
+    while (!stack.empty()) {
+      std::uint32_t node = stack.back();
+      stack.pop_back();
+      if (reached[node] != 0) {
+        continue;
+      }
+      reached[node] = 1;
+      const Node& n = nodes[node];
+      stack.insert(stack.end(), {n.nw, n.ne, n.sw, n.se});
+    }
+    std::vector<std::uint32_t> remap(nodes.size());
+    std::uint32_t kept = 0;
+    canonical.clear();
+    for (std::uint32_t node = 0; node < nodes.size(); ++node) {
+      if (reached[node] == 0) {
+        continue;
+      }
+      Node n = nodes[node];
+      if (n.level > 0) {
+        n.nw = remap[n.nw];
+        n.ne = remap[n.ne];
+        n.sw = remap[n.sw];
+        n.se = remap[n.se];
+        canonical.emplace(Children{n.nw, n.ne, n.sw, n.se}, kept);
+      }
+      remap[node] = kept;
+      nodes[kept++] = n;
+    }
+    nodes.resize(kept);
+    for (std::uint32_t& node : empty_nodes) {
+      node = remap[node];
+    }
+    root = remap[root];
+    results.clear();
+    // A large live pattern would otherwise be collected on every step.
+    next_collection = std::max(node_limit, std::size_t{2} * kept);
+  }
+
+  // Surrounds the node with empty space, keeping it centered.
+  std::uint32_t pad(std::uint32_t node) {
+    Node old = nodes[node];
+    std::uint32_t border = empty(old.level - 1);
+    return join(join(border, border, border, old.nw),
+                join(border, border, old.ne, border),
+                join(border, old.sw, border, border),
+                join(old.se, border, border, border));
+  }
+
+  // True when every live cell lies in the central quarter of the node, so
+  // the pattern cannot leave the result of successor().
+  [[nodiscard]] bool is_padded(std::uint32_t node) const {
+    const Node& n = nodes[node];
+    return n.population ==
+               nodes[nodes[nodes[n.nw].se].se].population +
+                   nodes[nodes[nodes[n.ne].sw].sw].population +
+                   nodes[nodes[nodes[n.sw].ne].ne].population +
+                   nodes[nodes[nodes[n.se].nw].nw].population;
+  }
+
+  // One generation of the central 2x2 of a 4x4 node.
+  std::uint32_t step_4x4(std::uint32_t node) {
+    int cells[4][4];
+    for (int width_iter = 0; width_iter < 4; ++width_iter) {
+      for (int length_iter = 0; length_iter < 4; ++length_iter) {
+        const Node& quadrant = nodes[width_iter < 2
+                                         ? (length_iter < 2 ? nodes[node].nw
+                                                            : nodes[node].ne)
+                                         : (length_iter < 2 ? nodes[node].sw
+                                                            : nodes[node].se)];
+        int row = width_iter % 2;
+        int column = length_iter % 2;
+        std::uint32_t leaf =
+            row == 0 ? (column == 0 ? quadrant.nw : quadrant.ne)
+                     : (column == 0 ? quadrant.sw : quadrant.se);
+        cells[width_iter][length_iter] = static_cast<int>(leaf);
+      }
+    }
+    std::uint32_t next[2][2];
+    for (int width_iter = 1; width_iter <= 2; ++width_iter) {
+      for (int length_iter = 1; length_iter <= 2; ++length_iter) {
+        int counter_live_neighbors = 0;
+        for (int row = -1; row <= 1; ++row) {
+          for (int column = -1; column <= 1; ++column) {
+            if (row != 0 || column != 0) {
+              counter_live_neighbors +=
+                  cells[width_iter + row][length_iter + column];
+            }
+          }
+        }
+        bool alive = cells[width_iter][length_iter] != 0;
+        next[width_iter - 1][length_iter - 1] =
+            (counter_live_neighbors == 3 ||
+             (alive && counter_live_neighbors == 2))
+                ? 1
+                : 0;
+      }
+    }
+    return join(next[0][0], next[0][1], next[1][0], next[1][1]);
+  }
+
+  // The central half of a level-k node advanced by 2^step_log generations,
+  // step_log <= k - 2.
+  std::uint32_t successor(std::uint32_t node, int step_log) {
+    Node n = nodes[node];
+    if (n.population == 0) {
+      return n.nw;
+    }
+    if (n.level == 2) {
+      return step_4x4(node);
+    }
+    step_log = std::min(step_log, n.level - 2);
+    std::uint64_t key = (std::uint64_t{node} << 8) | step_log;
+    if (auto cached = results.find(key); cached != results.end()) {
+      return cached->second;
+    }
+    Node nw = nodes[n.nw];
+    Node ne = nodes[n.ne];
+    Node sw = nodes[n.sw];
+    Node se = nodes[n.se];
+    // Nine overlapping sub-squares of half the size, advanced by up to
+    // 2^(k-3) generations.
+    std::uint32_t parts[3][3] = {
+        {successor(n.nw, step_log),
+         successor(join(nw.ne, ne.nw, nw.se, ne.sw), step_log),
+         successor(n.ne, step_log)},
+        {successor(join(nw.sw, nw.se, sw.nw, sw.ne), step_log),
+         successor(join(nw.se, ne.sw, sw.ne, se.nw), step_log),
+         successor(join(ne.sw, ne.se, se.nw, se.ne), step_log)},
+        {successor(n.sw, step_log),
+         successor(join(sw.ne, se.nw, sw.se, se.sw), step_log),
+         successor(n.se, step_log)}};
+    std::uint32_t quadrants[2][2];
+    for (int row = 0; row < 2; ++row) {
+      for (int column = 0; column < 2; ++column) {
+        std::uint32_t a = parts[row][column];
+        std::uint32_t b = parts[row][column + 1];
+        std::uint32_t c = parts[row + 1][column];
+        std::uint32_t d = parts[row + 1][column + 1];
+        if (step_log == n.level - 2) {
+          // Second half of the full-speed step.
+          quadrants[row][column] = successor(join(a, b, c, d), step_log);
+        } else {
+          // Only take the centre, without advancing further.
+          quadrants[row][column] = join(nodes[a].se, nodes[b].sw,
+                                        nodes[c].ne, nodes[d].nw);
+        }
+      }
+    }
+    std::uint32_t result = join(quadrants[0][0], quadrants[0][1],
+                                quadrants[1][0], quadrants[1][1]);
+    results.emplace(key, result);
+    return result;
+  }
+};
+
+Life::charmatrix random_field(int width, int length, double fill_percentage,
+                              std::mt19937& gen) {
+  std::uniform_real_distribution<> dis(0.0, 1.0);
+  Life::charmatrix field(width, std::vector<char>(length, ' '));
+  for (auto& row : field) {
+    for (char& cell : row) {
+      if (dis(gen) < fill_percentage) {
+        cell = '#';
+      }
+    }
+  }
+  return field;
+}
+
+void test_bit_life() {
+  std::mt19937 gen(1001);
+  const std::pair<int, int> sizes[] = {{1, 1},   {3, 3},    {10, 10},
+                                       {5, 64},  {7, 65},   {33, 127},
+                                       {64, 256}, {40, 300}, {2, 1000}};
+  for (const auto& [width, length] : sizes) {
+    for (double fill : {0.1, 0.35, 0.5, 0.9}) {
+      Life reference(random_field(width, length, fill, gen));
+      BitLife bits(reference.get_field());
+      assert(bits.to_field() == reference.get_field());
+      for (int generation = 0; generation < 20; ++generation) {
+        reference.step();
+        bits.step();
+        assert(bits.to_field() == reference.get_field());
+      }
+    }
+  }
+}
+
+void test_parallel_life() {
+  std::mt19937 gen(1002);
+  const std::pair<int, int> sizes[] = {{1, 1}, {3, 70}, {37, 200}, {129, 65}};
+  for (const auto& [width, length] : sizes) {
+    for (int threads : {1, 2, 3, 8}) {
+      Life reference(random_field(width, length, 0.4, gen));
+      ParallelLife parallel(reference.get_field(), threads);
+      for (int generations : {1, 5, 14}) {
+        for (int generation = 0; generation < generations; ++generation) {
+          reference.step();
+        }
+        parallel.run(generations);
+        assert(parallel.state().to_field() == reference.get_field());
+      }
+      parallel.run(0);
+      assert(parallel.state().to_field() == reference.get_field());
+    }
+  }
+}
+
+void test_tiled_life() {
+  std::mt19937 gen(1004);
+  const std::pair<int, int> sizes[] = {{1, 1}, {10, 10}, {65, 257}, {130, 600}};
+  for (const auto& [width, length] : sizes) {
+    for (double fill : {0.05, 0.4}) {
+      Life reference(random_field(width, length, fill, gen));
+      TiledLife tiled(reference.get_field());
+      for (int generation = 0; generation < 60; ++generation) {
+        reference.step();
+        tiled.step();
+        assert(tiled.state().to_field() == reference.get_field());
+      }
+    }
+  }
+
+  // A lone glider keeps only the tiles around it active.
+  Life::charmatrix field(512, std::vector<char>(1024, ' '));
+  const std::pair<int, int> glider[] = {{1, 2}, {2, 3}, {3, 1}, {3, 2}, {3, 3}};
+  for (const auto& [width_pos, length_pos] : glider) {
+    field[100 + width_pos][300 + length_pos] = '#';
+  }
+  Life reference(field);
+  TiledLife tiled(field);
+  for (int generation = 0; generation < 200; ++generation) {
+    reference.step();
+    tiled.step();
+    if (generation > 0) {
+      assert(tiled.get_active_tiles() <= 16);
+    }
+  }
+  assert(tiled.state().to_field() == reference.get_field());
+  assert(tiled.get_tile_count() == 8 * 4);
+}
+
+void test_hash_life() {
+  Life::charmatrix glider_field(40, std::vector<char>(40, ' '));
+  const std::pair<int, int> glider[] = {{1, 2}, {2, 3}, {3, 1}, {3, 2}, {3, 3}};
+  for (const auto& [width_pos, length_pos] : glider) {
+    glider_field[width_pos][length_pos] = '#';
+  }
+  Life reference(glider_field);
+  HashLife stepped(glider_field);
+  for (int generation = 1; generation <= 60; ++generation) {
+    reference.step();
+    stepped.advance(1);
+    assert(stepped.to_field(40, 40) == reference.get_field());
+    HashLife jumped(glider_field);
+    jumped.advance(generation);
+    assert(jumped.to_field(40, 40) == reference.get_field());
+  }
+
+  // A glider moves one cell diagonally every four generations.
+  HashLife far(glider_field);
+  far.advance(std::uint64_t{1} << 40);
+  assert(far.population() == 5);
+  assert(far.get_generation() == std::uint64_t{1} << 40);
+  for (const auto& [width_pos, length_pos] : glider) {
+    assert(far.is_alive(width_pos + (std::int64_t{1} << 38),
+                        length_pos + (std::int64_t{1} << 38)));
+  }
+
+  Life::charmatrix blinker_field(5, std::vector<char>(5, ' '));
+  blinker_field[2][1] = blinker_field[2][2] = blinker_field[2][3] = '#';
+  HashLife blinker(blinker_field);
+  blinker.advance(1000000);
+  assert(blinker.to_field(5, 5) == blinker_field);
+  blinker.advance(1);
+  assert(blinker.is_alive(1, 2) && blinker.is_alive(3, 2) &&
+         !blinker.is_alive(2, 1) && blinker.population() == 3);
+
+  std::mt19937 gen(1003);
+  for (int attempt = 0; attempt < 10; ++attempt) {
+    Life::charmatrix soup(64, std::vector<char>(64, ' '));
+    Life::charmatrix middle = random_field(12, 12, 0.45, gen);
+    for (int width_iter = 0; width_iter < 12; ++width_iter) {
+      for (int length_iter = 0; length_iter < 12; ++length_iter) {
+        soup[26 + width_iter][26 + length_iter] =
+            middle[width_iter][length_iter];
+      }
+    }
+    Life soup_reference(soup);
+    for (int generation = 0; generation < 13; ++generation) {
+      soup_reference.step();
+    }
+    HashLife soup_hash(soup);
+    soup_hash.advance(13);
+    assert(soup_hash.to_field(64, 64) == soup_reference.get_field());
+  }
+
+  // A small node limit forces collections while a soup keeps changing.
+  Life::charmatrix soup = random_field(64, 64, 0.4, gen);
+  HashLife collected(soup, 1 << 12);
+  HashLife uncollected(soup);
+  for (int round = 0; round < 50; ++round) {
+    collected.advance(20);
+    uncollected.advance(20);
+    assert(collected.population() == uncollected.population());
+    assert(collected.to_field(64, 64) == uncollected.to_field(64, 64));
+  }
+  assert(collected.node_count() < uncollected.node_count());
+}
+
+struct RunOptions {
+  bool bench = false;
+  int width = 1024;
+  int length = 1024;
+  unsigned seed = 1;
+  double fill_percentage = 0.5;
+  std::uint64_t generations = 100;
+  std::string engine = "bit";
+  int threads = static_cast<int>(std::thread::hardware_concurrency());
+  double max_fps = 1.0;
+  bool diff = false;
+};
+
+// Peak resident set size in KiB, or 0 where it cannot be queried.
+std::uint64_t peak_memory_kib() {
+#if defined(__unix__) || defined(__APPLE__)
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<std::uint64_t>(usage.ru_maxrss) / 1024;
+#else
+  return static_cast<std::uint64_t>(usage.ru_maxrss);
+#endif
+#else
+  return 0;
+#endif
+}
+
+std::uint64_t population_of(const Life::charmatrix& field) {
+  std::uint64_t count = 0;
+  for (const auto& row : field) {
+    for (char cell : row) {
+      count += cell == '#' ? 1 : 0;
+    }
+  }
+  return count;
+}
+
+// Runs one engine headless and reports its throughput. The board is always
+// seeded through Life::random_fill, so every engine starts from the same
+// field for a given seed. The bounded engines treat cells off the board as
+// dead and report the same final population; hash evolves the unbounded
+// plane, where patterns grow past the edges, so its population is excluded
+// from that cross-check and printed as such.
+int run_benchmark(const RunOptions& options) {
+  Life game(options.width, options.length);
+  game.set_headless(true);
+  game.random_fill(options.fill_percentage, options.seed);
+
+  using clock = std::chrono::steady_clock;
+  clock::time_point start;
+  std::uint64_t population = 0;
+  bool unbounded = false;
+  if (options.engine == "life") {
+    start = clock::now();
+    for (std::uint64_t generation = 0; generation < options.generations;
+         ++generation) {
+      game.update();
+    }
+    population = population_of(game.get_field());
+  } else if (options.engine == "bit") {
+    BitLife life(game.get_field());
+    start = clock::now();
+    for (std::uint64_t generation = 0; generation < options.generations;
+         ++generation) {
+      life.step();
+    }
+    population = life.population();
+  } else if (options.engine == "parallel") {
+    ParallelLife life(game.get_field(), options.threads);
+    start = clock::now();
+    life.run(options.generations);
+    population = life.state().population();
+  } else if (options.engine == "tiled") {
+    TiledLife life(game.get_field());
+    start = clock::now();
+    for (std::uint64_t generation = 0; generation < options.generations;
+         ++generation) {
+      life.step();
+    }
+    population = life.state().population();
+  } else if (options.engine == "hash") {
+    HashLife life(game.get_field());
+    start = clock::now();
+    life.advance(options.generations);
+    population = life.population();
+    unbounded = true;
+  } else {
+    std::cerr << "unknown engine: " << options.engine << "\n";
+    return 1;
+  }
+  double seconds = std::chrono::duration<double>(clock::now() - start).count();
+
+  double cells = static_cast<double>(options.width) * options.length;
+  std::cout << "engine: " << options.engine << "\n"
+            << "board: " << options.width << "x" << options.length
+            << ", seed " << options.seed << ", fill "
+            << options.fill_percentage << "\n"
+            << "generations: " << options.generations << "\n"
+            << "time: " << seconds << " s\n"
+            << "generations/sec: " << options.generations / seconds << "\n"
+            << "cells/sec: " << cells * options.generations / seconds << "\n"
+            << "population: " << population
+            << (unbounded ? " (unbounded plane, not comparable)" : "") << "\n"
+            << "peak memory: " << peak_memory_kib() << " KiB\n";
+  return 0;
+}
+
+// Shows the game in the terminal through a TerminalRenderer.
+int run_watch(const RunOptions& options) {
+  TerminalRenderer renderer(options.max_fps, options.diff);
+  if (options.engine == "life") {
+    Life game(options.width, options.length);
+    game.set_renderer(renderer);
+    game.random_fill(options.fill_percentage, options.seed);
+    for (std::uint64_t generation = 0; generation < options.generations;
+         ++generation) {
+      game.update();
+    }
+    return 0;
+  }
+  if (options.engine != "bit") {
+    std::cerr << "watching supports the life and bit engines\n";
+    return 1;
+  }
+  Life game(options.width, options.length);
+  game.set_headless(true);
+  game.random_fill(options.fill_percentage, options.seed);
+  BitLife life(game.get_field());
+  auto cell = [&life](int width_pos, int length_pos) {
+    return life.is_alive(width_pos, length_pos) ? '#' : ' ';
+  };
+  renderer.draw(options.width, options.length, cell);
+  for (std::uint64_t generation = 0; generation < options.generations;
+       ++generation) {
+    life.step();
+    renderer.draw(options.width, options.length, cell);
+  }
+  return 0;
+}
+
+void print_usage() {
+  std::cerr << "usage: life [--bench] [--size N | --width N --length N]\n"
+               "            [--seed N] [--fill P] [--generations N]\n"
+               "            [--engine life|bit|parallel|tiled|hash]"
+               " [--threads N]\n"
+               "            [--fps F] [--diff]\n";
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1) {
+    RunOptions options;
+    for (int arg = 1; arg < argc; ++arg) {
+      std::string name = argv[arg];
+      if (name == "--bench") {
+        options.bench = true;
+        continue;
+      }
+      if (name == "--diff") {
+        options.diff = true;
+        continue;
+      }
+      if (arg + 1 >= argc) {
+        print_usage();
+        return 1;
+      }
+      std::string value = argv[++arg];
+      if (name == "--size") {
+        options.width = options.length = std::stoi(value);
+      } else if (name == "--width") {
+        options.width = std::stoi(value);
+      } else if (name == "--length") {
+        options.length = std::stoi(value);
+      } else if (name == "--seed") {
+        options.seed = static_cast<unsigned>(std::stoul(value));
+      } else if (name == "--fill") {
+        options.fill_percentage = std::stod(value);
+      } else if (name == "--generations") {
+        options.generations = std::stoull(value);
+      } else if (name == "--engine") {
+        options.engine = value;
+      } else if (name == "--threads") {
+        options.threads = std::stoi(value);
+      } else if (name == "--fps") {
+        options.max_fps = std::stod(value);
+      } else {
+        print_usage();
+        return 1;
+      }
+    }
+    return options.bench ? run_benchmark(options) : run_watch(options);
+  }
+
+  test_bit_life();
+  test_parallel_life();
+  test_tiled_life();
+  test_hash_life();
   int moves = 100;
   Life game;
   game.random_fill();